@@ -133,20 +133,31 @@ static void deactivate(void)
     setup_game(false);
 }
 
+static int get_announce_pos(double tick_val)
+{
+    if (grid_widescreen)
+        return -grid_width + (int)((tick_val * announce_game.tick_freq) * announce_speed);
+    else
+        return -grid_height + (int)((tick_val * announce_game.tick_freq) * announce_speed);
+}
+
 static void tick(void)
 {
     tick_count++;
 
-    if (grid_widescreen)
-        announce_pos = -grid_width + (int)(((double)tick_count * announce_game.tick_freq) * announce_speed);
-    else
-        announce_pos = -grid_height + (int)(((double)tick_count * announce_game.tick_freq) * announce_speed);
+    announce_pos = get_announce_pos((double)tick_count);
 
     if (announce_pos > ((int)announce_wlen*FONT_SIZE)) {
         game_mode = MODE_DEAD;
     }
 }
 
+static void interpolate(double phase)
+{
+    if (tick_count > 0)
+        announce_pos = get_announce_pos((double)(tick_count - 1) + phase);
+}
+
 static void input(int player, int key_idx, bool key_val, int key_state)
 {
     (void)player;
@@ -272,11 +283,14 @@ const struct game announce_game = {
     false,
     false,
     0.1,
+    3,
+    CATCHUP_SLOW,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    interpolate,
     render,
     idle,
 };
@@ -0,0 +1,175 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matelight.h"
+
+// Art-Net 4, ArtDmx and ArtSync
+
+#define ARTNET_LEDS_PER_UNIVERSE    170     /* 510 of the 512 DMX channels */
+#define ARTNET_FIRST_UNIVERSE       0       /* 15 bit port-address: net, sub-net and universe */
+#define ARTNET_PROTOCOL_VERSION     14
+
+#define ARTNET_OP_DMX               0x5000
+#define ARTNET_OP_SYNC              0x5200
+
+#define ARTNET_DMX_HEADER_SIZE      18
+#define ARTNET_SYNC_SIZE            14
+#define ARTNET_DMX_PACKET_SIZE      (ARTNET_DMX_HEADER_SIZE + (ARTNET_LEDS_PER_UNIVERSE * 3))
+
+/* ArtDmx packets of a target, the headers are only written once */
+struct artnet_state {
+    uint16_t first_universe;
+    size_t num_universes;
+    unsigned char *packets;
+};
+
+struct artnet_stats {
+    uint64_t dmx;
+    uint64_t syncs;
+};
+
+static const unsigned char sync_packet[ARTNET_SYNC_SIZE] = {
+    'A', 'r', 't', '-', 'N', 'e', 't', 0,
+    ARTNET_OP_SYNC & 0xff, ARTNET_OP_SYNC >> 8,     /* little endian */
+    0, ARTNET_PROTOCOL_VERSION,
+    0, 0,                                           /* aux */
+};
+
+/* targets are numbered in the order they're initialized, after the previous target's universes */
+static uint16_t next_universe = ARTNET_FIRST_UNIVERSE;
+
+static struct artnet_stats stats = { 0 };
+
+static size_t universe_leds(size_t num_leds, size_t idx)
+{
+    return MIN(num_leds - (idx * ARTNET_LEDS_PER_UNIVERSE), ARTNET_LEDS_PER_UNIVERSE);
+}
+
+/* ArtDmx data is an even number of channels, the pad channel of an odd universe stays 0 */
+static size_t dmx_length(size_t leds)
+{
+    return ((leds * 3) + 1) & ~(size_t)1;
+}
+
+static void init(struct output_stream *stream, size_t num_leds)
+{
+    struct artnet_state *state = NULL;
+    unsigned char *packet;
+    uint16_t universe;
+    size_t len;
+    size_t i;
+
+    state = calloc(1, sizeof(*state));
+    if (! state) {
+        perror("artnet");
+        exit(EXIT_FAILURE);
+    }
+
+    state->num_universes = (num_leds + ARTNET_LEDS_PER_UNIVERSE - 1) / ARTNET_LEDS_PER_UNIVERSE;
+    state->first_universe = next_universe;
+    next_universe += state->num_universes;
+    state->packets = calloc(state->num_universes, ARTNET_DMX_PACKET_SIZE);
+    if (! state->packets) {
+        perror("artnet");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < state->num_universes; i++) {
+        packet = state->packets + (i * ARTNET_DMX_PACKET_SIZE);
+        universe = state->first_universe + i;
+        len = dmx_length(universe_leds(num_leds, i));
+
+        memcpy(packet, "Art-Net", 8);
+        packet[8] = ARTNET_OP_DMX & 0xff;
+        packet[9] = ARTNET_OP_DMX >> 8;
+        packet[10] = 0;
+        packet[11] = ARTNET_PROTOCOL_VERSION;
+        packet[12] = 0;                         /* sequence, set per frame */
+        packet[13] = 0;                         /* physical */
+        packet[14] = universe & 0xff;           /* sub-net and universe */
+        packet[15] = (universe >> 8) & 0x7f;    /* net */
+        packet[16] = (len >> 8) & 0xff;
+        packet[17] = len & 0xff;
+    }
+
+    stream->state = state;
+}
+
+static void free_state(struct output_stream *stream)
+{
+    struct artnet_state *state = stream->state;
+
+    /* all targets are freed before any of them is initialized again, so they're numbered from the start */
+    next_universe = ARTNET_FIRST_UNIVERSE;
+
+    if (! state)
+        return;
+
+    free(state->packets);
+    free(state);
+    stream->state = NULL;
+}
+
+static size_t max_packets(size_t num_leds)
+{
+    /* every universe and the ArtSync */
+    return ((num_leds + ARTNET_LEDS_PER_UNIVERSE - 1) / ARTNET_LEDS_PER_UNIVERSE) + 1;
+}
+
+static void encode(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, struct output_stream *stream)
+{
+    struct artnet_state *state = stream->state;
+    unsigned char *packet;
+    size_t first, len;
+    size_t i;
+    bool sent = false;
+
+    /* sequence numbers run from 1 to 255, 0 disables reordering on the node */
+    stream->sequence = (stream->sequence % 255) + 1;
+
+    for (i = 0; i < state->num_universes; i++) {
+        first = i * ARTNET_LEDS_PER_UNIVERSE * 3;
+        len = universe_leds(num_leds, i) * 3;
+
+        /* universes that didn't change keep their last frame on the node */
+        if (last_frame && memcmp(pixels + first, last_frame + first, len) == 0)
+            continue;
+
+        packet = state->packets + (i * ARTNET_DMX_PACKET_SIZE);
+        packet[12] = stream->sequence;
+        memcpy(packet + ARTNET_DMX_HEADER_SIZE, pixels + first, len);
+        output_add_packet(packet, ARTNET_DMX_HEADER_SIZE + dmx_length(universe_leds(num_leds, i)), NULL);
+        stats.dmx++;
+        sent = true;
+    }
+
+    /* nodes show the universes they got when the ArtSync arrives */
+    if (sent) {
+        output_add_packet(sync_packet, sizeof(sync_packet), NULL);
+        stats.syncs++;
+    }
+}
+
+static void print_stats(void)
+{
+    fprintf(stderr, "stats: output: artnet: dmx: %" PRIu64 ", syncs: %" PRIu64 "\n",
+            stats.dmx,
+            stats.syncs);
+
+    memset(&stats, '\0', sizeof(stats));
+}
+
+const struct output_backend artnet_backend = {
+    "artnet",
+    6454,
+    init,
+    free_state,
+    max_packets,
+    encode,
+    print_stats,
+};
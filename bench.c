@@ -0,0 +1,312 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "matelight.h"
+
+#define BENCH_FRAMES    2000
+
+struct bench_size {
+    int width;
+    int height;
+};
+
+static const struct bench_size bench_sizes[] = {
+    { 16, 16 },
+    { 32, 16 },
+    { 32, 32 },
+    { 64, 32 },
+    { 64, 64 },
+    { 128, 64 },
+    { 128, 128 },
+    { 256, 128 },
+};
+
+/* canvas and display sizes for the scaler */
+struct bench_scale {
+    struct bench_size canvas;
+    struct bench_size display;
+};
+
+static const struct bench_scale bench_scales[] = {
+    { { 20, 12 }, { 20, 12 } },
+    { { 20, 12 }, { 40, 24 } },
+    { { 20, 12 }, { 64, 32 } },
+    { { 64, 32 }, { 256, 128 } },
+    { { 64, 64 }, { 16, 16 } },
+    { { 256, 128 }, { 20, 12 } },
+};
+
+static void render_full(char *screen, int n)
+{
+    int x, y;
+
+    for (y = 0; y < grid_height; y++) {
+        for (x = 0; x < grid_width; x++) {
+            set_pixel(screen, y, x, COLOR_RGB((x + n) & 0xff, (y + n) & 0xff, n & 0xff));
+        }
+    }
+}
+
+static void render_sparse(char *screen, int n)
+{
+    int pos = n % (grid_width * grid_height);
+    int last = (pos + (grid_width * grid_height) - 1) % (grid_width * grid_height);
+
+    set_pixel(screen, last / grid_width, last % grid_width, COLOR_BLACK);
+    set_pixel(screen, pos / grid_width, pos % grid_width, COLOR_RGB(0xff, 0xff, 0xff));
+}
+
+static void run(const struct sockaddr_storage *addr, const char *name, void (*render)(char *screen, int n))
+{
+    struct output_timing before, after;
+    uint64_t start, render_time = 0;
+    int num_leds = grid_width * grid_height;
+    char *screen = NULL;
+    double frames;
+    int n;
+
+    screen = calloc(num_leds, 3);
+    if (! screen) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    output_init();
+    output_get_timing(&before);
+
+    for (n = 0; n < BENCH_FRAMES; n++) {
+        start = sched_now();
+        render(screen, n);
+        render_time += sched_now() - start;
+        output_frame(addr, screen, start);
+    }
+
+    output_get_timing(&after);
+    frames = after.frames - before.frames;
+
+    fprintf(stderr, "benchmark: %3dx%-3d %6d LEDs %-6s render: %8.1f us, encode: %8.1f us, send: %8.1f us, %5.1f packets, %5.2f ns per LED\n",
+            grid_width,
+            grid_height,
+            num_leds,
+            name,
+            ((double)render_time / BENCH_FRAMES) / 1000.0,
+            frames ? ((double)(after.encode - before.encode) / frames) / 1000.0 : 0.0,
+            frames ? ((double)(after.send - before.send) / frames) / 1000.0 : 0.0,
+            frames ? (double)(after.packets - before.packets) / frames : 0.0,
+            (double)(render_time + (after.encode - before.encode) + (after.send - before.send)) / ((double)BENCH_FRAMES * num_leds));
+
+    free(screen);
+}
+
+static void run_scaled(const struct sockaddr_storage *addr, const struct bench_scale *size, int filter)
+{
+    struct output_timing before, after;
+    int num_leds = size->display.width * size->display.height;
+    char *screen = NULL;
+    double frames;
+    int n;
+
+    grid_width = size->canvas.width;
+    grid_height = size->canvas.height;
+
+    screen = calloc(grid_width * grid_height, 3);
+    if (! screen) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    output_set_scale(size->display.width, size->display.height, filter);
+    output_init();
+    output_get_timing(&before);
+
+    for (n = 0; n < BENCH_FRAMES; n++) {
+        render_full(screen, n);
+        output_frame(addr, screen, sched_now());
+    }
+
+    output_get_timing(&after);
+    frames = after.frames - before.frames;
+
+    fprintf(stderr, "benchmark: %3dx%-3d -> %3dx%-3d %-7s scale: %8.1f us, %5.2f ns per LED\n",
+            size->canvas.width,
+            size->canvas.height,
+            size->display.width,
+            size->display.height,
+            scale_name(filter),
+            frames ? ((double)(after.scale - before.scale) / frames) / 1000.0 : 0.0,
+            frames ? (double)(after.scale - before.scale) / (frames * num_leds) : 0.0);
+
+    output_set_scale(0, 0, SCALE_NEAREST);
+    free(screen);
+}
+
+static void run_color(const struct sockaddr_storage *addr, const struct bench_size *size, const char *name)
+{
+    struct output_timing before, after;
+    int num_leds = size->width * size->height;
+    char *screen = NULL;
+    double frames;
+    int n;
+
+    grid_width = size->width;
+    grid_height = size->height;
+
+    screen = calloc(num_leds, 3);
+    if (! screen) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    output_init();
+    output_get_timing(&before);
+
+    for (n = 0; n < BENCH_FRAMES; n++) {
+        render_full(screen, n);
+        output_frame(addr, screen, sched_now());
+    }
+
+    output_get_timing(&after);
+    frames = after.frames - before.frames;
+
+    fprintf(stderr, "benchmark: %3dx%-3d %6d LEDs %-6s color: %8.1f us, %5.2f ns per LED, power: %8.1f us, %5.2f ns per LED\n",
+            size->width,
+            size->height,
+            num_leds,
+            name,
+            frames ? ((double)(after.color - before.color) / frames) / 1000.0 : 0.0,
+            frames ? (double)(after.color - before.color) / (frames * num_leds) : 0.0,
+            frames ? ((double)(after.power - before.power) / frames) / 1000.0 : 0.0,
+            frames ? (double)(after.power - before.power) / (frames * num_leds) : 0.0);
+
+    free(screen);
+}
+
+static void run_rgbw(const struct bench_size *size, int percent, double exponent)
+{
+    int num_leds = size->width * size->height;
+    unsigned char *rgb = NULL;
+    unsigned char *rgbw = NULL;
+    uint64_t start, total = 0;
+    int n;
+
+    rgb = malloc(num_leds * 3);
+    rgbw = malloc(num_leds * 4);
+    if (! rgb || ! rgbw) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+
+    rgbw_init(percent, exponent);
+    grid_width = size->width;
+    grid_height = size->height;
+
+    for (n = 0; n < BENCH_FRAMES; n++) {
+        render_full((char *)rgb, n);
+        start = sched_now();
+        rgbw_convert(rgb, rgbw, num_leds);
+        total += sched_now() - start;
+    }
+
+    fprintf(stderr, "benchmark: %3dx%-3d %6d LEDs rgbw %3d%% ^%.1f: %8.1f us, %5.2f ns per LED\n",
+            size->width,
+            size->height,
+            num_leds,
+            percent,
+            exponent,
+            ((double)total / BENCH_FRAMES) / 1000.0,
+            (double)total / ((double)BENCH_FRAMES * num_leds));
+
+    rgbw_init(100, 1.0);
+    free(rgb);
+    free(rgbw);
+}
+
+/* a socket on loopback nobody reads, a closed port would answer with ICMP errors
+ * and every frame would be sent in full again */
+static int open_sink(struct sockaddr_storage *addr)
+{
+    socklen_t len = sizeof(*addr);
+    int fd;
+
+    addr->ss_family = AF_INET;
+    ((struct sockaddr_in *)addr)->sin_port = 0;
+    ((struct sockaddr_in *)addr)->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd == -1) {
+        perror("socket");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(fd, (struct sockaddr *)addr, sizeof(struct sockaddr_in)) == -1 ||
+        getsockname(fd, (struct sockaddr *)addr, &len) == -1) {
+        perror("bind");
+        exit(EXIT_FAILURE);
+    }
+
+    return fd;
+}
+
+void benchmark(void)
+{
+    struct sockaddr_storage addr = { 0 };
+    size_t i;
+    int filter;
+    int sink_fd;
+
+    /* frames go to a sink on loopback, so only the local cost is measured */
+    sink_fd = open_sink(&addr);
+
+    for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+        grid_width = bench_sizes[i].width;
+        grid_height = bench_sizes[i].height;
+        grid_widescreen = true;
+
+        run(&addr, "full", render_full);
+        run(&addr, "sparse", render_sparse);
+    }
+
+    /* block scaling needs a display at least as large as the canvas */
+    for (i = 0; i < ARRAY_LENGTH(bench_scales); i++) {
+        for (filter = SCALE_NEAREST; filter <= SCALE_BOX; filter++) {
+            if (filter == SCALE_BLOCK && (bench_scales[i].display.width < bench_scales[i].canvas.width ||
+                                          bench_scales[i].display.height < bench_scales[i].canvas.height))
+                continue;
+            run_scaled(&addr, &bench_scales[i], filter);
+        }
+    }
+
+    /* gamma and half brightness, every byte goes through the tables, and a budget every frame is over */
+    color_init(2.2, 100, 90, 80);
+    color_set_brightness(50);
+    power_init(1000, POWER_CHANNEL_MA, 0);
+    for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+        run_color(&addr, &bench_sizes[i], "lut");
+    }
+
+    /* a Raspberry Pi is roughly ten times slower, at 50 fps a frame has 20 ms */
+    color_enable_dither(true);
+    for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+        run_color(&addr, &bench_sizes[i], "dither");
+    }
+    color_enable_dither(false);
+    color_init(1.0, 100, 100, 100);
+    color_set_brightness(100);
+    power_init(0, POWER_CHANNEL_MA, POWER_IDLE_MA);
+
+    /* min(r, g, b) and a curve */
+    for (i = 0; i < ARRAY_LENGTH(bench_sizes); i++) {
+        run_rgbw(&bench_sizes[i], 100, 1.0);
+        run_rgbw(&bench_sizes[i], 80, 2.0);
+    }
+
+    output_print_stats();
+    close(sink_fd);
+}
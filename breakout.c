@@ -29,9 +29,15 @@ static bool game_pause = false;
 
 static int paddle_x = 0;
 static int paddle_dir = MOVE_NONE;
+static int prev_paddle_x = 0;
+static int draw_paddle_x = 0;
 
 static double ball_y = 0.0;
 static double ball_x = 0.0;
+static double prev_ball_y = 0.0;
+static double prev_ball_x = 0.0;
+static double draw_ball_y = 0.0;
+static double draw_ball_x = 0.0;
 static double ball_dir = DIR_DOWN;
 
 static uint8_t bricks[BRICK_ROWS * MAX_GRID_WIDTH] = { 0 };
@@ -57,9 +63,12 @@ static void setup_game(bool start)
 
     paddle_x = (grid_width / 2) - (PADDLE_WIDTH / 2);
     paddle_dir = MOVE_NONE;
+    prev_paddle_x = draw_paddle_x = paddle_x;
 
     ball_y = (double)(grid_height / 2);
     ball_x = (double)(grid_width / 2);
+    prev_ball_y = draw_ball_y = ball_y;
+    prev_ball_x = draw_ball_x = ball_x;
     ball_dir = DIR_DOWN;
     num_bricks = 0;
 
@@ -87,6 +96,10 @@ static bool doit(void)
     double hit_offset;
     int ball_yi, ball_xi;
 
+    prev_ball_y = ball_y;
+    prev_ball_x = ball_x;
+    prev_paddle_x = paddle_x;
+
     if (game_pause)
         return true;
 
@@ -175,6 +188,15 @@ static void tick(void)
         game_mode = MODE_DEAD;
 }
 
+static void interpolate(double phase)
+{
+    draw_ball_y = prev_ball_y + ((ball_y - prev_ball_y) * phase);
+    draw_ball_x = prev_ball_x + ((ball_x - prev_ball_x) * phase);
+
+    /* the paddle too, so it stays in step with the ball */
+    draw_paddle_x = lround(prev_paddle_x + ((paddle_x - prev_paddle_x) * phase));
+}
+
 static void input(int player, int key_idx, bool key_val, int key_state)
 {
     (void)player;
@@ -239,12 +261,12 @@ static void draw(char *screen)
 
     // paddle
     for (x = 0; x < PADDLE_WIDTH; x++) {
-        set_pixel(screen, PADDLE_Y, paddle_x + x, COLOR_WHITE);
+        set_pixel(screen, PADDLE_Y, draw_paddle_x + x, COLOR_WHITE);
     }
 
     // ball
-    y = lround(ball_y);
-    x = lround(ball_x);
+    y = lround(draw_ball_y);
+    x = lround(draw_ball_x);
     if (y >= 0 && y < grid_height && x >= 0 && x < grid_width) {
         set_pixel(screen, y, x, COLOR_BLUE);
     }
@@ -270,11 +292,14 @@ const struct game breakout_game = {
     true,
     false,
     0.1,
+    3,
+    CATCHUP_DROP,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    interpolate,
     render,
     idle,
 };
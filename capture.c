@@ -0,0 +1,628 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "matelight.h"
+
+// Frame capture and golden frame verification
+//
+// A capture file is a struct capture_header followed by records, each a
+// type byte and its payload. Numbers are unsigned LEB128 varints.
+//
+// - CAPTURE_STEP: nanoseconds since the previous step, one per main loop
+//   iteration, everything up to the next step happened at that time
+// - CAPTURE_JOYSTICKS: number of players, then the players
+// - CAPTURE_INPUT: player, key, pressed, key state
+// - CAPTURE_ANNOUNCE: color, background color, speed as a double, length
+//   and text of an announcement from another thread
+// - CAPTURE_WLED_IP: length and text of a WLED address found by mDNS
+// - CAPTURE_FRAME: runs of changed LEDs against the previous frame, each
+//   the LEDs skipped, the LEDs in the run and their RGB values, a run of 0
+//   LEDs ends the frame
+//
+// The main loop only appends records to a buffer, a thread writes them to
+// the file. --verify runs the main loop on the capture's clock instead of
+// the real one, feeds it the captured input and compares every frame.
+
+#define CAPTURE_STEP        'T'
+#define CAPTURE_JOYSTICKS   'J'
+#define CAPTURE_INPUT       'I'
+#define CAPTURE_ANNOUNCE    'A'
+#define CAPTURE_WLED_IP     'W'
+#define CAPTURE_FRAME       'F'
+
+#define CAPTURE_BUFFER_SIZE (4 * 1024 * 1024)
+#define CAPTURE_VARINT_SIZE 10
+
+// Unchanged LEDs shorter than this don't end a run, a new run costs up to two varints
+#define CAPTURE_RUN_GAP     2
+
+struct capture_buffer {
+    unsigned char *data;
+    size_t len;
+};
+
+struct verify_stats {
+    uint64_t frames;
+    uint64_t mismatched;
+    uint64_t missing;
+    uint64_t unexpected;
+    uint64_t first_mismatch;
+    uint64_t first_mismatch_time;
+    size_t first_mismatch_leds;
+};
+
+static int capture_fd = -1;
+static pthread_t capture_thread;
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static struct capture_buffer buffers[2] = { { NULL, 0 }, { NULL, 0 } };
+static struct capture_buffer *fill = &buffers[0];
+static bool capture_failed = false;
+
+static size_t frame_size = 0;
+static unsigned char *last_frame = NULL;
+static unsigned char *record = NULL;
+static uint64_t last_step = 0;
+
+static const unsigned char *verify_data = NULL;
+static size_t verify_size = 0;
+static size_t verify_pos = 0;
+static uint64_t start_time = 0;
+static struct verify_stats stats = { 0 };
+
+static unsigned char *put_varint(unsigned char *p, uint64_t val)
+{
+    while (val >= 0x80) {
+        *p++ = (val & 0x7f) | 0x80;
+        val >>= 7;
+    }
+    *p++ = val;
+
+    return p;
+}
+
+static void *capture_writer(void *arg)
+{
+    struct capture_buffer *drain;
+    const unsigned char *p;
+    ssize_t written;
+    size_t len;
+
+    (void)arg;
+
+    for (;;) {
+        (void)pthread_mutex_lock(&capture_mutex);
+        while (! fill->len) {
+            (void)pthread_cond_wait(&capture_cond, &capture_mutex);
+        }
+        drain = fill;
+        fill = (fill == &buffers[0]) ? &buffers[1] : &buffers[0];
+        (void)pthread_mutex_unlock(&capture_mutex);
+
+        for (p = drain->data, len = drain->len; len; p += written, len -= written) {
+            written = write(capture_fd, p, len);
+            if (written == -1 && errno == EINTR) {
+                written = 0;
+                continue;
+            }
+            if (written == -1) {
+                perror("capture");
+                (void)pthread_mutex_lock(&capture_mutex);
+                capture_failed = true;
+                (void)pthread_mutex_unlock(&capture_mutex);
+                break;
+            }
+        }
+        drain->len = 0;
+    }
+
+    return NULL;
+}
+
+static void capture_append(const unsigned char *data, size_t len)
+{
+    if (capture_fd == -1)
+        return;
+
+    (void)pthread_mutex_lock(&capture_mutex);
+    if (capture_failed) {
+        (void)pthread_mutex_unlock(&capture_mutex);
+        return;
+    }
+    if (fill->len + len > CAPTURE_BUFFER_SIZE) {
+        /* later frames are deltas against the ones that are lost, the rest of the capture is useless */
+        capture_failed = true;
+        (void)pthread_mutex_unlock(&capture_mutex);
+        fprintf(stderr, "capture: writer can't keep up, capture stopped\n");
+        return;
+    }
+    memcpy(fill->data + fill->len, data, len);
+    fill->len += len;
+    (void)pthread_cond_signal(&capture_cond);
+    (void)pthread_mutex_unlock(&capture_mutex);
+}
+
+static void init_frames(void)
+{
+    frame_size = grid_width * grid_height * 3;
+
+    /* a frame that changes every other LED is the worst case */
+    last_frame = calloc(1, frame_size);
+    record = malloc(1 + (frame_size * 2) + (CAPTURE_VARINT_SIZE * 2));
+    if (! last_frame || ! record) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void capture_init(const char *path, const struct capture_header *header)
+{
+    size_t i;
+
+    capture_fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (capture_fd == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    init_frames();
+    for (i = 0; i < ARRAY_LENGTH(buffers); i++) {
+        buffers[i].data = malloc(CAPTURE_BUFFER_SIZE);
+        if (! buffers[i].data) {
+            perror("malloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    last_step = header->start_time;
+    capture_append((const unsigned char *)header, sizeof(*header));
+
+    if (pthread_create(&capture_thread, NULL, capture_writer, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+    (void)pthread_detach(capture_thread);
+}
+
+void capture_step(uint64_t now)
+{
+    unsigned char *p = record;
+
+    if (capture_fd == -1)
+        return;
+
+    *p++ = CAPTURE_STEP;
+    p = put_varint(p, now - last_step);
+    capture_append(record, p - record);
+    last_step = now;
+}
+
+void capture_input(const struct joystick *joystick)
+{
+    unsigned char *p = record;
+
+    if (capture_fd == -1)
+        return;
+
+    *p++ = CAPTURE_INPUT;
+    p = put_varint(p, joystick->player);
+    p = put_varint(p, joystick->last_key_idx);
+    *p++ = joystick->last_key_val;
+    p = put_varint(p, joystick->key_state);
+    capture_append(record, p - record);
+}
+
+void capture_joysticks(const int *players, size_t num_players)
+{
+    unsigned char *p = record;
+    size_t i;
+
+    if (capture_fd == -1)
+        return;
+
+    *p++ = CAPTURE_JOYSTICKS;
+    p = put_varint(p, num_players);
+    for (i = 0; i < num_players; i++) {
+        p = put_varint(p, players[i]);
+    }
+    capture_append(record, p - record);
+}
+
+static void capture_text(int type, const unsigned char *prefix, size_t prefix_len, const char *text)
+{
+    size_t len = strlen(text);
+    unsigned char *buf;
+    unsigned char *p;
+
+    if (capture_fd == -1)
+        return;
+
+    /* announcements can be longer than any record of a frame */
+    buf = malloc(1 + prefix_len + CAPTURE_VARINT_SIZE + len);
+    if (! buf) {
+        perror("malloc");
+        return;
+    }
+
+    p = buf;
+    *p++ = type;
+    if (prefix_len) {
+        memcpy(p, prefix, prefix_len);
+        p += prefix_len;
+    }
+    p = put_varint(p, len);
+    memcpy(p, text, len);
+    p += len;
+    capture_append(buf, p - buf);
+
+    free(buf);
+}
+
+void capture_announce(const char *text, unsigned int color, unsigned int bgcolor, double speed)
+{
+    unsigned char prefix[(CAPTURE_VARINT_SIZE * 2) + sizeof(speed)];
+    unsigned char *p = prefix;
+
+    p = put_varint(p, color);
+    p = put_varint(p, bgcolor);
+    memcpy(p, &speed, sizeof(speed));
+    p += sizeof(speed);
+    capture_text(CAPTURE_ANNOUNCE, prefix, p - prefix, text);
+}
+
+void capture_wled_ip(const char *address)
+{
+    capture_text(CAPTURE_WLED_IP, NULL, 0, address);
+}
+
+static bool unchanged(const unsigned char *pixels, size_t first, size_t len)
+{
+    return memcmp(pixels + (first * 3), last_frame + (first * 3), len * 3) == 0;
+}
+
+void capture_frame(const char *frame)
+{
+    const unsigned char *pixels = (const unsigned char *)frame;
+    size_t num_leds = frame_size / 3;
+    size_t first, last, pos = 0;
+    unsigned char *p = record;
+
+    if (capture_fd == -1)
+        return;
+
+    *p++ = CAPTURE_FRAME;
+    for (first = 0; first < num_leds; first++) {
+        if (unchanged(pixels, first, 1))
+            continue;
+
+        /* a run ends at CAPTURE_RUN_GAP unchanged LEDs in a row */
+        last = first + 1;
+        while (last < num_leds && ! unchanged(pixels, last, MIN(CAPTURE_RUN_GAP, num_leds - last)))
+            last++;
+
+        p = put_varint(p, first - pos);
+        p = put_varint(p, last - first);
+        memcpy(p, pixels + (first * 3), (last - first) * 3);
+        p += (last - first) * 3;
+        pos = last;
+        first = last;
+    }
+    p = put_varint(p, 0);
+    p = put_varint(p, 0);
+
+    memcpy(last_frame, pixels, frame_size);
+    capture_append(record, p - record);
+}
+
+static bool get_varint(uint64_t *val)
+{
+    unsigned int shift = 0;
+    unsigned char c;
+
+    *val = 0;
+    do {
+        if (verify_pos >= verify_size || shift > 63)
+            return false;
+        c = verify_data[verify_pos++];
+        *val |= (uint64_t)(c & 0x7f) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return true;
+}
+
+static void truncated(void)
+{
+    fprintf(stderr, "verify: capture is truncated at offset %zu\n", verify_pos);
+    exit(EXIT_FAILURE);
+}
+
+static int next_record(void)
+{
+    if (verify_pos >= verify_size)
+        return -1;
+
+    return verify_data[verify_pos];
+}
+
+static void read_frame(void)
+{
+    size_t num_leds = frame_size / 3;
+    size_t pos = 0;
+    uint64_t skip, len;
+
+    verify_pos++;
+    for (;;) {
+        if (! get_varint(&skip) || ! get_varint(&len))
+            truncated();
+        if (skip > num_leds - pos || len > num_leds - pos - skip || len * 3 > verify_size - verify_pos)
+            truncated();
+        pos += skip;
+        if (! len)
+            break;
+        memcpy(last_frame + (pos * 3), verify_data + verify_pos, len * 3);
+        verify_pos += len * 3;
+        pos += len;
+    }
+}
+
+void verify_init(const char *path, struct capture_header *header)
+{
+    struct stat st;
+    int fd;
+
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        perror(path);
+        exit(EXIT_FAILURE);
+    }
+
+    if (fstat(fd, &st) == -1) {
+        perror("fstat");
+        exit(EXIT_FAILURE);
+    }
+
+    verify_size = st.st_size;
+    if (verify_size < sizeof(*header)) {
+        fprintf(stderr, "verify: %s is not a capture\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    verify_data = mmap(NULL, verify_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (verify_data == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    memcpy(header, verify_data, sizeof(*header));
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0 || header->version != CAPTURE_VERSION) {
+        fprintf(stderr, "verify: %s is not a capture\n", path);
+        exit(EXIT_FAILURE);
+    }
+    if (header->width < MIN_GRID_WIDTH || header->width > MAX_GRID_WIDTH || header->height < MIN_GRID_HEIGHT || header->height > MAX_GRID_HEIGHT) {
+        fprintf(stderr, "verify: invalid grid resolution %" PRIu32 " x %" PRIu32 "\n", header->width, header->height);
+        exit(EXIT_FAILURE);
+    }
+    header->ip_address[sizeof(header->ip_address) - 1] = '\0';
+    header->wled_address[sizeof(header->wled_address) - 1] = '\0';
+
+    verify_pos = sizeof(*header);
+    start_time = header->start_time;
+    last_step = header->start_time;
+
+    grid_width = header->width;
+    grid_height = header->height;
+    init_frames();
+}
+
+bool verify_step(uint64_t *now)
+{
+    int players[MAX_JOYSTICKS];
+    size_t num_players;
+    int player, key_idx, key_state;
+    bool key_val;
+    char *text;
+    unsigned int color, bgcolor;
+    double speed;
+    char address[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
+    uint64_t delta;
+    int type;
+
+    /* anything the previous step didn't use means the run went differently */
+    for (;;) {
+        type = next_record();
+        if (type == -1)
+            return false;
+        if (type == CAPTURE_STEP)
+            break;
+
+        if (type == CAPTURE_FRAME) {
+            read_frame();
+            stats.missing++;
+        } else if (type == CAPTURE_INPUT) {
+            (void)verify_input(&player, &key_idx, &key_val, &key_state);
+            stats.unexpected++;
+        } else if (type == CAPTURE_JOYSTICKS) {
+            (void)verify_joysticks(players, &num_players);
+            stats.unexpected++;
+        } else if (type == CAPTURE_ANNOUNCE) {
+            (void)verify_announce(&text, &color, &bgcolor, &speed);
+            free(text);
+            stats.unexpected++;
+        } else if (type == CAPTURE_WLED_IP) {
+            (void)verify_wled_ip(address, sizeof(address));
+            stats.unexpected++;
+        } else {
+            fprintf(stderr, "verify: unknown record at offset %zu\n", verify_pos);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    verify_pos++;
+    if (! get_varint(&delta))
+        truncated();
+
+    last_step += delta;
+    *now = last_step;
+
+    return true;
+}
+
+bool verify_input(int *player, int *key_idx, bool *key_val, int *key_state)
+{
+    uint64_t val[3];
+
+    if (next_record() != CAPTURE_INPUT)
+        return false;
+
+    verify_pos++;
+    if (! get_varint(&val[0]) || ! get_varint(&val[1]) || verify_pos >= verify_size)
+        truncated();
+    *key_val = verify_data[verify_pos++];
+    if (! get_varint(&val[2]))
+        truncated();
+
+    *player = val[0];
+    *key_idx = val[1];
+    *key_state = val[2];
+
+    return true;
+}
+
+bool verify_joysticks(int *players, size_t *num_players)
+{
+    uint64_t n, player;
+    size_t i;
+
+    if (next_record() != CAPTURE_JOYSTICKS)
+        return false;
+
+    verify_pos++;
+    if (! get_varint(&n))
+        truncated();
+
+    *num_players = 0;
+    for (i = 0; i < n; i++) {
+        if (! get_varint(&player))
+            truncated();
+        if (i < MAX_JOYSTICKS)
+            players[(*num_players)++] = player;
+    }
+
+    return true;
+}
+
+static char *get_text(void)
+{
+    uint64_t len;
+    char *text;
+
+    if (! get_varint(&len) || len > verify_size - verify_pos)
+        truncated();
+
+    text = malloc(len + 1);
+    if (! text) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    memcpy(text, verify_data + verify_pos, len);
+    text[len] = '\0';
+    verify_pos += len;
+
+    return text;
+}
+
+bool verify_announce(char **text, unsigned int *color, unsigned int *bgcolor, double *speed)
+{
+    uint64_t val[2];
+
+    if (next_record() != CAPTURE_ANNOUNCE)
+        return false;
+
+    verify_pos++;
+    if (! get_varint(&val[0]) || ! get_varint(&val[1]) || sizeof(*speed) > verify_size - verify_pos)
+        truncated();
+    memcpy(speed, verify_data + verify_pos, sizeof(*speed));
+    verify_pos += sizeof(*speed);
+
+    *color = val[0];
+    *bgcolor = val[1];
+    *text = get_text();
+
+    return true;
+}
+
+bool verify_wled_ip(char *address, size_t size)
+{
+    char *text;
+
+    if (next_record() != CAPTURE_WLED_IP)
+        return false;
+
+    verify_pos++;
+    text = get_text();
+    snprintf(address, size, "%s", text);
+    free(text);
+
+    return true;
+}
+
+void verify_frame(const char *frame)
+{
+    const unsigned char *pixels = (const unsigned char *)frame;
+    size_t i, leds = 0;
+
+    stats.frames++;
+
+    if (next_record() != CAPTURE_FRAME) {
+        stats.unexpected++;
+        return;
+    }
+
+    read_frame();
+    if (memcmp(pixels, last_frame, frame_size) == 0)
+        return;
+
+    if (! stats.mismatched) {
+        for (i = 0; i < frame_size; i += 3) {
+            if (memcmp(pixels + i, last_frame + i, 3) != 0)
+                leds++;
+        }
+        stats.first_mismatch = stats.frames;
+        stats.first_mismatch_time = last_step - start_time;
+        stats.first_mismatch_leds = leds;
+    }
+    stats.mismatched++;
+}
+
+bool verify_finish(void)
+{
+    bool ok = ! stats.mismatched && ! stats.missing && ! stats.unexpected;
+
+    fprintf(stderr, "verify: frames: %" PRIu64 ", mismatched: %" PRIu64 ", missing: %" PRIu64 ", unexpected: %" PRIu64 "\n",
+            stats.frames,
+            stats.mismatched,
+            stats.missing,
+            stats.unexpected);
+    if (stats.mismatched) {
+        fprintf(stderr, "verify: first mismatch: frame %" PRIu64 " at %.3f secs, %zu LEDs differ\n",
+                stats.first_mismatch,
+                (double)stats.first_mismatch_time / (double)SCHED_NSEC_PER_SEC,
+                stats.first_mismatch_leds);
+    }
+    fprintf(stderr, "verify: %s\n", ok ? "passed" : "FAILED");
+
+    return ok;
+}
@@ -0,0 +1,196 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "matelight.h"
+
+// Color correction
+//
+// Gamma, white balance and brightness are folded into one lookup table per
+// channel, so correcting a frame is a single lookup per byte. The tables
+// are rebuilt by the thread sending the frames when the brightness
+// changed, any other thread only stores the new brightness. The lookup is
+// plain C, at about 1 ns per LED it's fast enough, AArch64 could do it 16
+// bytes at a time with vqtbl4q_u8 and three vqtbx4q_u8.
+//
+// With dithering the tables give 8.8 fixed point levels instead, into a 16
+// bit frame, and every channel keeps the fraction it couldn't show. It's
+// added to the next frame, so over a few frames a LED averages out to the
+// level between two 8 bit steps. The sums never exceed 16 bits, full
+// brightness is 255.0.
+
+static double gamma_value = 1.0;
+static int white_balance[3] = { 100, 100, 100 };
+static int brightness = 100;            /* written by any thread */
+static int lut_brightness = -1;         /* the tables are for this brightness */
+static bool identity = true;
+static unsigned char lut[3][256];
+
+static bool dither = false;
+static uint16_t lut16[3][256];
+static uint16_t *levels = NULL;        /* the 16 bit frame */
+static unsigned char *residue = NULL;   /* fraction of every channel carried to the next frame */
+static size_t dither_leds = 0;
+
+static void build_luts(int percent)
+{
+    double level, scale;
+    int c, i;
+
+    identity = gamma_value == 1.0 && percent == 100;
+    for (c = 0; c < 3; c++) {
+        identity = identity && white_balance[c] == 100;
+        scale = (255.0 * percent * white_balance[c]) / 10000.0;
+        for (i = 0; i < 256; i++) {
+            level = pow((double)i / 255.0, gamma_value) * scale;
+            lut[c][i] = (unsigned char)MIN(lround(level), 255);
+            lut16[c][i] = (uint16_t)MIN(lround(level * 256.0), 255 * 256);
+        }
+    }
+
+    lut_brightness = percent;
+}
+
+void color_init(double gamma, int red, int green, int blue)
+{
+    gamma_value = gamma;
+    white_balance[0] = red;
+    white_balance[1] = green;
+    white_balance[2] = blue;
+    lut_brightness = -1;
+}
+
+void color_enable_dither(bool enabled)
+{
+    dither = enabled;
+}
+
+void color_set_brightness(int percent)
+{
+    __atomic_store_n(&brightness, MAX(0, MIN(percent, 100)), __ATOMIC_RELAXED);
+}
+
+int color_get_brightness(void)
+{
+    return __atomic_load_n(&brightness, __ATOMIC_RELAXED);
+}
+
+static void alloc_dither(size_t num_leds)
+{
+    if (num_leds == dither_leds)
+        return;
+
+    free(levels);
+    free(residue);
+    levels = malloc(num_leds * 3 * sizeof(*levels));
+    residue = calloc(num_leds, 3);
+    if (! levels || ! residue) {
+        perror("color_frame");
+        exit(EXIT_FAILURE);
+    }
+    dither_leds = num_leds;
+}
+
+/* dst = (level + residue) >> 8, the low byte is the next residue */
+static void dither_channels(unsigned char *dst, size_t len)
+{
+    size_t i = 0;
+    unsigned int sum;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i low = _mm_set1_epi16(0xff);
+    __m128i r, lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        r = _mm_loadu_si128((const __m128i *)(residue + i));
+        lo = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(levels + i)), _mm_unpacklo_epi8(r, zero));
+        hi = _mm_add_epi16(_mm_loadu_si128((const __m128i *)(levels + i + 8)), _mm_unpackhi_epi8(r, zero));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8)));
+        _mm_storeu_si128((__m128i *)(residue + i), _mm_packus_epi16(_mm_and_si128(lo, low), _mm_and_si128(hi, low)));
+    }
+#elif defined(__ARM_NEON)
+    uint16x8_t lo, hi;
+    uint8x16_t r;
+
+    for (; i + 16 <= len; i += 16) {
+        r = vld1q_u8(residue + i);
+        lo = vaddw_u8(vld1q_u16(levels + i), vget_low_u8(r));
+        hi = vaddw_u8(vld1q_u16(levels + i + 8), vget_high_u8(r));
+        vst1q_u8(dst + i, vcombine_u8(vshrn_n_u16(lo, 8), vshrn_n_u16(hi, 8)));
+        vst1q_u8(residue + i, vcombine_u8(vmovn_u16(lo), vmovn_u16(hi)));
+    }
+#endif
+
+    for (; i < len; i++) {
+        sum = levels[i] + residue[i];
+        dst[i] = sum >> 8;
+        residue[i] = sum & 0xff;
+    }
+}
+
+static void dither_frame(const unsigned char *src, unsigned char *dst, size_t num_leds)
+{
+    size_t i;
+
+    alloc_dither(num_leds);
+
+    for (i = 0; i < num_leds; i++) {
+        levels[(i * 3) + 0] = lut16[0][src[(i * 3) + 0]];
+        levels[(i * 3) + 1] = lut16[1][src[(i * 3) + 1]];
+        levels[(i * 3) + 2] = lut16[2][src[(i * 3) + 2]];
+    }
+
+    dither_channels(dst, num_leds * 3);
+}
+
+bool color_frame(const unsigned char *src, unsigned char *dst, size_t num_leds)
+{
+    const unsigned char *r = lut[0];
+    const unsigned char *g = lut[1];
+    const unsigned char *b = lut[2];
+    int percent = color_get_brightness();
+    size_t i = 0;
+
+    if (percent != lut_brightness)
+        build_luts(percent);
+    if (identity)
+        return false;
+
+    if (dither) {
+        dither_frame(src, dst, num_leds);
+        return true;
+    }
+
+    /* four LEDs at a time, the lookups don't depend on each other */
+    for (; i + 4 <= num_leds; i += 4, src += 12, dst += 12) {
+        dst[0] = r[src[0]];
+        dst[1] = g[src[1]];
+        dst[2] = b[src[2]];
+        dst[3] = r[src[3]];
+        dst[4] = g[src[4]];
+        dst[5] = b[src[5]];
+        dst[6] = r[src[6]];
+        dst[7] = g[src[7]];
+        dst[8] = b[src[8]];
+        dst[9] = r[src[9]];
+        dst[10] = g[src[10]];
+        dst[11] = b[src[11]];
+    }
+    for (; i < num_leds; i++, src += 3, dst += 3) {
+        dst[0] = r[src[0]];
+        dst[1] = g[src[1]];
+        dst[2] = b[src[2]];
+    }
+
+    return true;
+}
@@ -1,6 +1,7 @@
 #!/usr/bin/env python3
 
 import argparse
+import mmap
 import os
 import socket
 import queue
@@ -14,10 +15,20 @@ import tkinter.ttk
 DEFAULT_WIDTH = 20
 DEFAULT_HEIGHT = 12
 UDP_PORT = 21324
+DDP_PORT = 4048
+DDP_HEADER_SIZE = 10
+DDP_FLAGS_VER_MASK = 0xc0
+DDP_FLAGS_VER1 = 0x40
+DDP_FLAGS_PUSH = 0x01
+DDP_TIMEOUT = 2.5
 JS_EVENT_BUTTON = 0x01
 JS_EVENT_AXIS = 0x02
 JS_EVENT_INIT = 0x80
 CIRCLE_RADIUS = 18
+SHM_MAGIC = 0x4d4c4652
+SHM_HEADER = struct.Struct('<IIIIIIQII')
+SHM_SLOT_HEADER = struct.Struct('<QQ')
+SHM_POLL_INTERVAL = 0.005
 
 
 # https://kno.wled.ge/interfaces/udp-realtime/
@@ -37,15 +48,62 @@ class WLED:
         self.last_update = None
         self.update_interval = None
         self.pixels_expire = None
+        self.ddp_pixels = list(self.pixels)
+        self.ddp_sequence = None
 
     def udp_receiver(self):
         while True:
             (data, address) = self.sock.recvfrom(65536)
             self.queue.put((data, address))
 
+    # matelight --shm=<name>, the frames don't go through the network at all
+    def shm_receiver(self, name):
+        path = os.path.join('/dev/shm', name)
+        shm = None
+        inode = None
+        last_sequence = None
+        while True:
+            try:
+                st = os.stat(path)
+                if st.st_ino != inode:
+                    with open(path, 'rb') as f:
+                        shm = mmap.mmap(f.fileno(), 0, prot=mmap.PROT_READ)
+                    inode = st.st_ino
+                    last_sequence = None
+            except (OSError, ValueError):
+                shm = None
+                inode = None
+            if shm:
+                magic, version, width, height, num_slots, slot_size, sequence, futex, reserved = SHM_HEADER.unpack_from(shm, 0)
+                if magic == SHM_MAGIC and sequence and sequence != last_sequence:
+                    offset = SHM_HEADER.size + ((sequence % num_slots) * slot_size)
+                    (slot_sequence, timestamp) = SHM_SLOT_HEADER.unpack_from(shm, offset)
+                    pixels = shm[offset + SHM_SLOT_HEADER.size:offset + SHM_SLOT_HEADER.size + (width * height * 3)]
+                    # the slot was overwritten while it was copied, there's a newer frame anyway
+                    if slot_sequence == sequence and SHM_SLOT_HEADER.unpack_from(shm, offset)[0] == sequence:
+                        self.queue.put((pixels, None))
+                        last_sequence = sequence
+            time.sleep(SHM_POLL_INTERVAL)
+
+    def shm_process(self, data, now):
+        if self.last_update:
+            self.update_interval = now - self.last_update
+        self.last_update = now
+        self.protocol = 'SHM'
+        self.sender = None
+        self.timeout = None
+        self.pixels_expire = None
+        for idx in range(min(len(data) // 3, len(self.pixels))):
+            self.pixels[idx] = tuple(data[idx * 3:(idx * 3) + 3])
+        self.pixel_data = True
+        self.pixels_updated = True
+
     def udp_process(self):
         while not self.queue.empty():
             (data, address) = self.queue.get()
+            if self.sock is None:
+                self.shm_process(data, time.time())
+                continue
             if address:
                 self.sender = address[0]
             else:
@@ -53,6 +111,10 @@ class WLED:
             now = time.time()
             if len(data) < 2:
                 continue
+            # http://www.3waylabs.com/ddp/
+            if (data[0] & DDP_FLAGS_VER_MASK) == DDP_FLAGS_VER1:
+                self.ddp_process(data, now)
+                continue
             if self.last_update:
                 self.update_interval = now - self.last_update
             else:
@@ -115,6 +177,32 @@ class WLED:
             else:
                 self.protocol = f'Unknown ({protocol_num})'
 
+    def ddp_process(self, data, now):
+        if len(data) < DDP_HEADER_SIZE:
+            return
+        flags, sequence, data_type, dest_id = tuple(data[0:4])
+        offset, length = struct.unpack('>IH', data[4:10])
+        self.protocol = 'DDP'
+        if sequence and self.ddp_sequence and sequence != (self.ddp_sequence % 15) + 1:
+            print(f'DDP: sequence {sequence} after {self.ddp_sequence}')
+        self.ddp_sequence = sequence
+        pixel_data = data[DDP_HEADER_SIZE:DDP_HEADER_SIZE + length]
+        idx = offset // 3
+        for i in range(0, len(pixel_data) - 2, 3):
+            if idx < len(self.ddp_pixels):
+                self.ddp_pixels[idx] = tuple(pixel_data[i:i + 3])
+            idx += 1
+        # frames are shown when the packet with the push flag arrives
+        if flags & DDP_FLAGS_PUSH:
+            if self.last_update:
+                self.update_interval = now - self.last_update
+            self.last_update = now
+            self.pixels = list(self.ddp_pixels)
+            self.pixel_data = True
+            self.pixels_updated = True
+            self.timeout = DDP_TIMEOUT
+            self.pixels_expire = now + DDP_TIMEOUT
+
     def update_state(self):
         now = time.time()
         active = self.pixel_data and (not self.pixels_expire or now < self.pixels_expire)
@@ -309,10 +397,13 @@ parser.add_argument('--height', help='Grid height', type=int, default=DEFAULT_HE
 parser.add_argument('--address', help='Listen address', default='127.0.0.1')
 parser.add_argument('--port', help='Listen port', type=int, default=UDP_PORT)
 parser.add_argument('--fifo', help='Joypad FIFO')
+parser.add_argument('--shm', help='Read frames from matelight --shm=<name> instead of UDP')
 args = parser.parse_args()
 
-sock = socket.socket(family=socket.AF_INET, type=socket.SOCK_DGRAM)
-sock.bind((args.address, args.port))
+sock = None
+if not args.shm:
+    sock = socket.socket(family=socket.AF_INET, type=socket.SOCK_DGRAM)
+    sock.bind((args.address, args.port))
 
 if args.fifo and not os.path.exists(args.fifo):
     os.mkfifo(args.fifo)
@@ -324,7 +415,10 @@ else:
 
 wled = WLED(sock, width=args.width, height=args.height)
 
-udp_thread = threading.Thread(target=wled.udp_receiver, name='udp-receiver', daemon=True)
+if args.shm:
+    udp_thread = threading.Thread(target=wled.shm_receiver, args=(args.shm,), name='shm-receiver', daemon=True)
+else:
+    udp_thread = threading.Thread(target=wled.udp_receiver, name='udp-receiver', daemon=True)
 udp_thread.start()
 
 fifo_thread = threading.Thread(target=joypad.fifo_writer, name='fifo-writer', daemon=True)
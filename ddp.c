@@ -0,0 +1,131 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "matelight.h"
+
+// Distributed Display Protocol, http://www.3waylabs.com/ddp/
+
+#define DDP_HEADER_SIZE     10
+#define DDP_MAX_LEDS        480     /* 1440 bytes of data, an unfragmented datagram over IPv6 as well */
+
+#define DDP_FLAGS_VER1      0x40
+#define DDP_FLAGS_PUSH      0x01
+#define DDP_TYPE_RGB24      0x0b
+#define DDP_ID_DISPLAY      1
+
+// Changed LEDs closer than this are sent in one packet instead of starting a new one
+#define DDP_RUN_GAP         ((DDP_HEADER_SIZE + OUTPUT_UDP_OVERHEAD) / 3)
+
+struct ddp_stats {
+    uint64_t packets;
+    uint64_t full;
+    uint64_t delta;
+};
+
+static struct ddp_stats stats = { 0 };
+
+static size_t max_packets(size_t num_leds)
+{
+    return MAX((num_leds + DDP_MAX_LEDS - 1) / DDP_MAX_LEDS, OUTPUT_MAX_DELTA_RUNS);
+}
+
+static void encode_range(const unsigned char *pixels, size_t first, size_t last, bool push, struct output_stream *stream)
+{
+    unsigned char *packet;
+    uint32_t offset;
+    size_t len;
+
+    for (; first <= last; first += len) {
+        len = MIN((last - first) + 1, DDP_MAX_LEDS);
+        offset = first * 3;
+
+        /* sequence numbers run from 1 to 15, 0 means unused */
+        stream->sequence = (stream->sequence % 15) + 1;
+
+        packet = output_new_packet(DDP_HEADER_SIZE + (len * 3));
+        packet[0] = DDP_FLAGS_VER1;
+        if (push && (first + len) > last)
+            packet[0] |= DDP_FLAGS_PUSH;
+        packet[1] = stream->sequence;
+        packet[2] = DDP_TYPE_RGB24;
+        packet[3] = DDP_ID_DISPLAY;
+        packet[4] = (offset >> 24) & 0xff;
+        packet[5] = (offset >> 16) & 0xff;
+        packet[6] = (offset >> 8) & 0xff;
+        packet[7] = offset & 0xff;
+        packet[8] = ((len * 3) >> 8) & 0xff;
+        packet[9] = (len * 3) & 0xff;
+        memcpy(packet + DDP_HEADER_SIZE, pixels + offset, len * 3);
+        stats.packets++;
+    }
+}
+
+static size_t range_cost(size_t first, size_t last)
+{
+    size_t len = (last - first) + 1;
+    size_t n = (len + DDP_MAX_LEDS - 1) / DDP_MAX_LEDS;
+
+    return (n * (OUTPUT_UDP_OVERHEAD + DDP_HEADER_SIZE)) + (len * 3);
+}
+
+static void encode(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, struct output_stream *stream)
+{
+    struct output_delta delta;
+    const struct output_run *runs = delta.runs;
+    size_t full_cost, runs_cost;
+    size_t i;
+
+    /* the receiver shows the frame when the last packet with the push flag arrives */
+    if (! last_frame) {
+        encode_range(pixels, 0, num_leds - 1, true, stream);
+        stats.full++;
+        return;
+    }
+
+    output_find_delta(pixels, last_frame, num_leds, DDP_RUN_GAP, DDP_MAX_LEDS, &delta);
+    if (! delta.changed)
+        return;
+
+    full_cost = range_cost(0, num_leds - 1);
+
+    runs_cost = SIZE_MAX;
+    if (! delta.too_many_runs) {
+        runs_cost = 0;
+        for (i = 0; i < delta.num_runs; i++) {
+            runs_cost += range_cost(runs[i].first, runs[i].last);
+        }
+    }
+
+    if (runs_cost < full_cost) {
+        for (i = 0; i < delta.num_runs; i++) {
+            encode_range(pixels, runs[i].first, runs[i].last, i == delta.num_runs - 1, stream);
+        }
+    } else {
+        encode_range(pixels, runs[0].first, runs[delta.num_runs - 1].last, true, stream);
+    }
+    stats.delta++;
+}
+
+static void print_stats(void)
+{
+    fprintf(stderr, "stats: output: ddp: packets: %" PRIu64 ", full frames: %" PRIu64 ", delta frames: %" PRIu64 "\n",
+            stats.packets,
+            stats.full,
+            stats.delta);
+
+    memset(&stats, '\0', sizeof(stats));
+}
+
+const struct output_backend ddp_backend = {
+    "ddp",
+    4048,
+    NULL,
+    NULL,
+    max_packets,
+    encode,
+    print_stats,
+};
@@ -124,11 +124,14 @@ const struct game debug_game = {
     false,
     true,
     0.1,
+    3,
+    CATCHUP_DROP,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    NULL,
     render,
     idle,
 };
@@ -0,0 +1,274 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "matelight.h"
+
+// E1.31 (sACN), ANSI E1.31-2018
+
+#define E131_LEDS_PER_UNIVERSE  170     /* 510 of the 512 DMX slots */
+#define E131_MAX_UNIVERSES      (((MAX_GRID_WIDTH * MAX_GRID_HEIGHT) + E131_LEDS_PER_UNIVERSE - 1) / E131_LEDS_PER_UNIVERSE)
+#define E131_MAX_ALL_UNIVERSES  (MAX_OUTPUT_TARGETS * E131_MAX_UNIVERSES)
+#define E131_FIRST_UNIVERSE     1
+#define E131_SYNC_UNIVERSE      64000   /* receivers latch all universes when this arrives */
+#define E131_PRIORITY           100
+#define E131_SOURCE_NAME        "matelight"
+
+#define E131_DATA_HEADER_SIZE   126
+#define E131_SYNC_PACKET_SIZE   49
+
+#define VECTOR_ROOT_E131_DATA               0x00000004
+#define VECTOR_ROOT_E131_EXTENDED           0x00000008
+#define VECTOR_E131_DATA_PACKET             0x00000002
+#define VECTOR_E131_EXTENDED_SYNCHRONIZATION 0x00000001
+#define VECTOR_DMP_SET_PROPERTY             0x02
+
+// Multicast group of a universe, 239.255.<universe high>.<universe low>
+#define E131_MULTICAST_GROUP(universe)  (0xefff0000 | ((universe) & 0xffff))
+
+/* every target has its own universes and sync universe, so multicast targets don't share
+ * groups, the multicast destinations must stay valid until the batch is sent */
+struct e131_state {
+    uint16_t first_universe;
+    uint16_t sync_universe;
+    struct sockaddr_storage sync_group;
+    struct sockaddr_storage groups[];
+};
+
+struct e131_stats {
+    uint64_t window_start;
+    uint64_t syncs;
+    uint64_t universe_packets[E131_MAX_ALL_UNIVERSES];
+};
+
+static const unsigned char acn_packet_identifier[12] = { 'A', 'S', 'C', '-', 'E', '1', '.', '1', '7', 0, 0, 0 };
+
+static unsigned char cid[16];
+static bool have_cid = false;
+
+/* targets are numbered in the order they're initialized, after the previous target's universes */
+static uint16_t next_universe = E131_FIRST_UNIVERSE;
+static uint16_t next_sync_universe = E131_SYNC_UNIVERSE;
+
+static struct e131_stats stats = { 0 };
+
+static size_t num_universes(size_t num_leds)
+{
+    return (num_leds + E131_LEDS_PER_UNIVERSE - 1) / E131_LEDS_PER_UNIVERSE;
+}
+
+static void init(struct output_stream *stream, size_t num_leds)
+{
+    struct e131_state *state = NULL;
+
+    state = calloc(1, sizeof(*state) + (num_universes(num_leds) * sizeof(state->groups[0])));
+    if (! state) {
+        perror("e131");
+        exit(EXIT_FAILURE);
+    }
+
+    state->first_universe = next_universe;
+    state->sync_universe = next_sync_universe;
+    next_universe += num_universes(num_leds);
+    next_sync_universe++;
+
+    stream->state = state;
+}
+
+static void free_state(struct output_stream *stream)
+{
+    /* all targets are freed before any of them is initialized again, so they're numbered from the start */
+    next_universe = E131_FIRST_UNIVERSE;
+    next_sync_universe = E131_SYNC_UNIVERSE;
+
+    free(stream->state);
+    stream->state = NULL;
+}
+
+static size_t max_packets(size_t num_leds)
+{
+    /* every universe and the sync packet */
+    return num_universes(num_leds) + 1;
+}
+
+static void put16(unsigned char *p, uint16_t val)
+{
+    p[0] = (val >> 8) & 0xff;
+    p[1] = val & 0xff;
+}
+
+static void put32(unsigned char *p, uint32_t val)
+{
+    p[0] = (val >> 24) & 0xff;
+    p[1] = (val >> 16) & 0xff;
+    p[2] = (val >> 8) & 0xff;
+    p[3] = val & 0xff;
+}
+
+static void init_cid(void)
+{
+    unsigned int seed = sched_now() ^ getpid();
+    size_t i;
+
+    /* a random UUID identifies this source for as long as it runs,
+     * it doesn't come from rand() so the games see the same numbers with every protocol */
+    for (i = 0; i < sizeof(cid); i++) {
+        cid[i] = rand_r(&seed) & 0xff;
+    }
+    cid[6] = (cid[6] & 0x0f) | 0x40;
+    cid[8] = (cid[8] & 0x3f) | 0x80;
+    have_cid = true;
+}
+
+static void root_layer(unsigned char *packet, size_t len, uint32_t vector)
+{
+    put16(packet + 0, 0x0010);          /* preamble size */
+    put16(packet + 2, 0x0000);          /* postamble size */
+    memcpy(packet + 4, acn_packet_identifier, sizeof(acn_packet_identifier));
+    put16(packet + 16, 0x7000 | (len - 16));
+    put32(packet + 18, vector);
+    memcpy(packet + 22, cid, sizeof(cid));
+}
+
+static const struct sockaddr_storage *multicast_group(struct sockaddr_storage *group, const struct output_stream *stream, uint16_t universe)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)group;
+
+    memset(group, '\0', sizeof(*group));
+    sin->sin_family = AF_INET;
+    sin->sin_port = ((const struct sockaddr_in *)stream->addr)->sin_port;
+    sin->sin_addr.s_addr = htonl(E131_MULTICAST_GROUP(universe));
+
+    return group;
+}
+
+static bool is_multicast(const struct output_stream *stream)
+{
+    return stream->addr->ss_family == AF_INET &&
+           IN_MULTICAST(ntohl(((const struct sockaddr_in *)stream->addr)->sin_addr.s_addr));
+}
+
+static void encode_universe(const unsigned char *pixels, size_t num_leds, size_t idx, struct output_stream *stream)
+{
+    struct e131_state *state = stream->state;
+    uint16_t universe = state->first_universe + idx;
+    size_t first = idx * E131_LEDS_PER_UNIVERSE;
+    size_t slots = MIN(num_leds - first, E131_LEDS_PER_UNIVERSE) * 3;
+    size_t len = E131_DATA_HEADER_SIZE + slots;
+    unsigned char *packet;
+
+    if (is_multicast(stream)) {
+        packet = output_new_packet_to(len, multicast_group(&state->groups[idx], stream, universe));
+    } else {
+        packet = output_new_packet(len);
+    }
+
+    root_layer(packet, len, VECTOR_ROOT_E131_DATA);
+
+    /* framing layer */
+    put16(packet + 38, 0x7000 | (len - 38));
+    put32(packet + 40, VECTOR_E131_DATA_PACKET);
+    memset(packet + 44, '\0', 64);
+    memcpy(packet + 44, E131_SOURCE_NAME, sizeof(E131_SOURCE_NAME));
+    packet[108] = E131_PRIORITY;
+    put16(packet + 109, state->sync_universe);
+    packet[111] = stream->sequence;
+    packet[112] = 0;                    /* options */
+    put16(packet + 113, universe);
+
+    /* DMP layer */
+    put16(packet + 115, 0x7000 | (len - 115));
+    packet[117] = VECTOR_DMP_SET_PROPERTY;
+    packet[118] = 0xa1;                 /* address and data type */
+    put16(packet + 119, 0x0000);        /* first property address */
+    put16(packet + 121, 0x0001);        /* address increment */
+    put16(packet + 123, slots + 1);
+    packet[125] = 0x00;                 /* DMX start code */
+    memcpy(packet + E131_DATA_HEADER_SIZE, pixels + (first * 3), slots);
+
+    stats.universe_packets[universe - E131_FIRST_UNIVERSE]++;
+}
+
+static void encode_sync(struct output_stream *stream)
+{
+    struct e131_state *state = stream->state;
+    unsigned char *packet;
+
+    if (is_multicast(stream)) {
+        packet = output_new_packet_to(E131_SYNC_PACKET_SIZE, multicast_group(&state->sync_group, stream, state->sync_universe));
+    } else {
+        packet = output_new_packet(E131_SYNC_PACKET_SIZE);
+    }
+
+    root_layer(packet, E131_SYNC_PACKET_SIZE, VECTOR_ROOT_E131_EXTENDED);
+
+    put16(packet + 38, 0x7000 | (E131_SYNC_PACKET_SIZE - 38));
+    put32(packet + 40, VECTOR_E131_EXTENDED_SYNCHRONIZATION);
+    packet[44] = stream->sequence;
+    put16(packet + 45, state->sync_universe);
+    put16(packet + 47, 0x0000);         /* reserved */
+
+    stats.syncs++;
+}
+
+static void encode(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, struct output_stream *stream)
+{
+    size_t first, len;
+    size_t i;
+    bool sent = false;
+
+    if (! have_cid)
+        init_cid();
+    if (! stats.window_start)
+        stats.window_start = sched_now();
+
+    stream->sequence++;
+
+    /* universes that didn't change keep their last frame on the receiver */
+    for (i = 0; i < num_universes(num_leds); i++) {
+        first = i * E131_LEDS_PER_UNIVERSE;
+        len = MIN(num_leds - first, E131_LEDS_PER_UNIVERSE) * 3;
+        if (last_frame && memcmp(pixels + (first * 3), last_frame + (first * 3), len) == 0)
+            continue;
+
+        encode_universe(pixels, num_leds, i, stream);
+        sent = true;
+    }
+
+    if (sent)
+        encode_sync(stream);
+}
+
+static void print_stats(void)
+{
+    uint64_t now = sched_now();
+    double secs = stats.window_start ? (double)(now - stats.window_start) / (double)SCHED_NSEC_PER_SEC : 0.0;
+    size_t i;
+
+    fprintf(stderr, "stats: output: e131: syncs: %" PRIu64 " (%.1f/s)", stats.syncs, secs > 0.0 ? stats.syncs / secs : 0.0);
+    for (i = 0; i < E131_MAX_ALL_UNIVERSES; i++) {
+        if (stats.universe_packets[i])
+            fprintf(stderr, ", universe %zu: %.1f/s", E131_FIRST_UNIVERSE + i, secs > 0.0 ? stats.universe_packets[i] / secs : 0.0);
+    }
+    fprintf(stderr, "\n");
+
+    memset(&stats, '\0', sizeof(stats));
+    stats.window_start = now;
+}
+
+const struct output_backend e131_backend = {
+    "e131",
+    5568,
+    init,
+    free_state,
+    max_packets,
+    encode,
+    print_stats,
+};
@@ -0,0 +1,193 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+
+#include "matelight.h"
+
+#define MAX_EVENT_HANDLERS  (MAX_JOYSTICKS + 16)
+#define MAX_EVENTS          16
+
+struct event_handler {
+    int fd;
+    event_func func;
+    void *arg;
+};
+
+static int epoll_fd = -1;
+static int notify_fd = -1;
+static struct event_handler handlers[MAX_EVENT_HANDLERS];
+static size_t num_handlers = 0;
+
+static struct event_handler *find_handler(int fd)
+{
+    size_t i;
+
+    for (i = 0; i < num_handlers; i++) {
+        if (handlers[i].fd == fd)
+            return &handlers[i];
+    }
+
+    return NULL;
+}
+
+static void notify_event(int fd, unsigned int events, void *arg)
+{
+    uint64_t val;
+
+    (void)events;
+    (void)arg;
+
+    /* just drain the counter, the main loop handles the async requests after every wakeup */
+    (void)read(fd, &val, sizeof(val));
+}
+
+void event_init(void)
+{
+    size_t i;
+
+    for (i = 0; i < MAX_EVENT_HANDLERS; i++) {
+        handlers[i].fd = -1;
+    }
+    num_handlers = 0;
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd == -1) {
+        perror("epoll_create1");
+        exit(EXIT_FAILURE);
+    }
+
+    notify_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (notify_fd == -1) {
+        perror("eventfd");
+        exit(EXIT_FAILURE);
+    }
+
+    if (! event_add(notify_fd, notify_event, NULL)) {
+        exit(EXIT_FAILURE);
+    }
+}
+
+bool event_add(int fd, event_func func, void *arg)
+{
+    struct event_handler *handler = NULL;
+    struct epoll_event ev = { 0 };
+
+    if (epoll_fd == -1 || fd < 0)
+        return false;
+
+    handler = find_handler(fd);
+    if (! handler)
+        handler = find_handler(-1);
+    if (! handler && num_handlers < MAX_EVENT_HANDLERS)
+        handler = &handlers[num_handlers++];
+    if (! handler) {
+        fprintf(stderr, "event_add: too many file descriptors\n");
+        return false;
+    }
+
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        if (errno != EEXIST || epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) != 0) {
+            perror("epoll_ctl");
+            if (handler->fd == -1 && handler == &handlers[num_handlers - 1])
+                num_handlers--;
+            return false;
+        }
+    }
+
+    handler->fd = fd;
+    handler->func = func;
+    handler->arg = arg;
+
+    return true;
+}
+
+void event_del(int fd)
+{
+    struct event_handler *handler = NULL;
+
+    if (epoll_fd == -1 || fd < 0)
+        return;
+
+    handler = find_handler(fd);
+    if (! handler)
+        return;
+
+    (void)epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, NULL);
+    handler->fd = -1;
+    handler->func = NULL;
+    handler->arg = NULL;
+}
+
+bool event_add_signal(int signo, event_func func, void *arg)
+{
+    sigset_t mask;
+    int fd;
+
+    /* the signal is blocked in every thread started afterwards and delivered through the loop */
+    sigemptyset(&mask);
+    sigaddset(&mask, signo);
+    if (pthread_sigmask(SIG_BLOCK, &mask, NULL) != 0) {
+        fprintf(stderr, "event_add_signal: unable to block signal %d\n", signo);
+        return false;
+    }
+
+    fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (fd == -1) {
+        perror("signalfd");
+        return false;
+    }
+
+    if (! event_add(fd, func, arg)) {
+        close(fd);
+        return false;
+    }
+
+    return true;
+}
+
+void event_notify(void)
+{
+    uint64_t val = 1;
+
+    if (notify_fd == -1)
+        return;
+
+    (void)write(notify_fd, &val, sizeof(val));
+}
+
+int event_wait(int timeout)
+{
+    struct epoll_event events[MAX_EVENTS];
+    struct event_handler *handler = NULL;
+    int ret;
+    int i;
+
+    ret = epoll_wait(epoll_fd, events, ARRAY_LENGTH(events), timeout);
+    if (ret == -1) {
+        if (errno != EINTR)
+            perror("epoll_wait");
+        return 0;
+    }
+
+    for (i = 0; i < ret; i++) {
+        /* a handler may have been removed by an earlier callback in this batch */
+        handler = find_handler(events[i].data.fd);
+        if (handler && handler->func) {
+            handler->func(handler->fd, events[i].events, handler->arg);
+        }
+    }
+
+    return ret;
+}
@@ -215,11 +215,14 @@ const struct game flappy_game = {
     true,
     false,
     0.1,
+    3,
+    CATCHUP_DROP,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    NULL,
     render,
     idle,
 };
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <poll.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <linux/limits.h>
 #include <linux/joystick.h>
@@ -15,6 +16,9 @@
 
 #include "matelight.h"
 
+#define INPUT_POLL_INTERVAL 100 /* ms */
+#define REPLAY_FD           -2  /* not -1, which marks a free joystick */
+
 static struct joystick joysticks[MAX_JOYSTICKS] = { 0 };
 static size_t num_joysticks = 0;
 
@@ -32,6 +36,7 @@ void input_reset(void)
 
     for (i = 0; i < num_joysticks; i++) {
         if (joysticks[i].fd != -1) {
+            event_del(joysticks[i].fd);
             if (joysticks[i].type == INPUT_JOYSTICK) {
                 close(joysticks[i].fd);
             }
@@ -42,6 +47,7 @@ void input_reset(void)
 
     if (udev_ctx != NULL) {
         if (udev_monitor != NULL) {
+            event_del(udev_monitor_get_fd(udev_monitor));
             udev_monitor_unref(udev_monitor);
         }
         udev_monitor = NULL;
@@ -88,6 +94,26 @@ int get_available_player(void)
     return player;
 }
 
+static void joystick_event(int fd, unsigned int events, void *arg)
+{
+    struct joystick *joystick = arg;
+
+    /* the data itself is read by read_joystick(), but a hangup without data
+     * (e.g. a FIFO without a writer) would wake up the main loop forever */
+    if ((events & (EPOLLHUP | EPOLLERR)) && ! (events & EPOLLIN)) {
+        event_del(fd);
+        joystick->polled = true;
+    }
+}
+
+static void watch_joystick(struct joystick *joystick)
+{
+    joystick->polled = ! event_add(joystick->fd, joystick_event, joystick);
+    if (joystick->polled) {
+        fprintf(stderr, "unable to watch %s, falling back to polling\n", joystick->devnode);
+    }
+}
+
 bool open_joystick(const char *devnode, struct stat *st, bool check_joydev)
 {
     int fd = -1;
@@ -160,6 +186,8 @@ bool open_joystick(const char *devnode, struct stat *st, bool check_joydev)
     joystick->last_key_val = false;
     memset(joysticks[num_joysticks].key_history, '\0', sizeof(joysticks[num_joysticks].key_history));
 
+    watch_joystick(joystick);
+
     fprintf(stderr, "initialized joystick: %s, (player: %d, axes: %d, buttons: %d, name: %s)\n", devnode, player, axes, buttons, name);
 
     return true;
@@ -252,6 +280,8 @@ void init_keyboard(void)
     joystick->last_key_val = false;
     memset(joysticks[num_joysticks].key_history, '\0', sizeof(joysticks[num_joysticks].key_history));
 
+    watch_joystick(joystick);
+
     fprintf(stderr, "initialized keyboard, (player: %d)\n", player);
 }
 
@@ -313,6 +343,7 @@ static void remove_udev_device(struct udev_device *dev)
 
         if (strcmp(joysticks[i].devnode, devnode) == 0) {
             fprintf(stderr, "remove_udev_device: removed joystick %s\n", devnode);
+            event_del(joysticks[i].fd);
             close(joysticks[i].fd);
             joysticks[i].fd = -1;
         }
@@ -329,6 +360,7 @@ void init_udev_hotplug(void)
 
     if (udev_ctx != NULL) {
         if (udev_monitor != NULL) {
+            event_del(udev_monitor_get_fd(udev_monitor));
             udev_monitor_unref(udev_monitor);
         }
         udev_monitor = NULL;
@@ -348,6 +380,8 @@ void init_udev_hotplug(void)
     if (udev_monitor) {
         udev_monitor_filter_add_match_subsystem_devtype(udev_monitor, "input", NULL);
         udev_monitor_enable_receiving(udev_monitor);
+        /* devices are received by udev_monitor_poll() from read_joystick() */
+        (void)event_add(udev_monitor_get_fd(udev_monitor), NULL, NULL);
     } else {
         fprintf(stderr, "init_udev_hotplug: unable to initialize udev monitor.\n");
     }
@@ -589,6 +623,14 @@ static void process_joystick_event(struct joystick *joystick, struct js_event *e
     }
 }
 
+static void add_key_history(struct joystick *joystick)
+{
+    if (joystick->last_key_idx != KEYPAD_NONE && joystick->last_key_val) {
+        memmove(&joystick->key_history[1], &joystick->key_history[0], sizeof(joystick->key_history) - sizeof(joystick->key_history[0]));
+        joystick->key_history[0] = joystick->last_key_idx;
+    }
+}
+
 bool read_joystick(struct joystick **joystick_ptr)
 {
     size_t i;
@@ -633,10 +675,7 @@ bool read_joystick(struct joystick **joystick_ptr)
         return false;
     }
 
-    if (joystick->last_key_idx != KEYPAD_NONE && joystick->last_key_val) {
-        memmove(&joystick->key_history[1], &joystick->key_history[0], sizeof(joystick->key_history) - sizeof(joystick->key_history[0]));
-        joystick->key_history[0] = joystick->last_key_idx;
-    }
+    add_key_history(joystick);
 
     *joystick_ptr = joystick;
     return true;
@@ -685,3 +724,91 @@ bool has_player(int player)
 
     return false;
 }
+
+size_t get_players(int *players, size_t max_players)
+{
+    size_t i;
+    size_t n = 0;
+
+    for (i = 0; i < num_joysticks && n < max_players; i++) {
+        if (joysticks[i].fd != -1)
+            players[n++] = joysticks[i].player;
+    }
+
+    return n;
+}
+
+static struct joystick *find_replay_joystick(int player)
+{
+    struct joystick *joystick;
+    size_t i;
+
+    for (i = 0; i < num_joysticks; i++) {
+        if (joysticks[i].type == INPUT_REPLAY && joysticks[i].player == player)
+            return &joysticks[i];
+    }
+
+    joystick = get_free_joystick();
+    if (! joystick)
+        return NULL;
+
+    memset(joystick, '\0', sizeof(*joystick));
+    joystick->type = INPUT_REPLAY;
+    joystick->fd = -1;
+    joystick->player = player;
+    snprintf(joystick->name, sizeof(joystick->name), "replay %d", player);
+
+    return joystick;
+}
+
+void replay_joysticks(const int *players, size_t num_players)
+{
+    struct joystick *joystick;
+    size_t i;
+
+    for (i = 0; i < num_joysticks; i++) {
+        if (joysticks[i].type == INPUT_REPLAY)
+            joysticks[i].fd = -1;
+    }
+
+    /* replayed joysticks have no file, but count as connected */
+    for (i = 0; i < num_players; i++) {
+        joystick = find_replay_joystick(players[i]);
+        if (joystick)
+            joystick->fd = REPLAY_FD;
+    }
+}
+
+struct joystick *replay_joystick(int player, int key_idx, bool key_val, int key_state)
+{
+    struct joystick *joystick = find_replay_joystick(player);
+
+    if (! joystick)
+        return NULL;
+
+    joystick->last_key_idx = key_idx;
+    joystick->last_key_val = key_val;
+    joystick->key_state = key_state;
+    add_key_history(joystick);
+
+    return joystick;
+}
+
+int input_timeout(void)
+{
+    size_t i;
+
+    for (i = 0; i < num_joysticks; i++) {
+        if (joysticks[i].fd == -1)
+            continue;
+
+        if (joysticks[i].polled)
+            return INPUT_POLL_INTERVAL;
+
+        /* keyboard keys are released after a couple of reads without input */
+        if (joysticks[i].type == INPUT_KEYBOARD && joysticks[i].last_key_val)
+            return INPUT_POLL_INTERVAL;
+    }
+
+    return -1;
+}
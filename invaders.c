@@ -428,11 +428,14 @@ const struct game invaders_game = {
     true,
     false,
     0.1,
+    3,
+    CATCHUP_DROP,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    NULL,
     render,
     idle,
 };
@@ -1,4 +1,8 @@
 #include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -47,3 +51,62 @@ void ip_init(void)
 
     freeifaddrs(ifa);
 }
+
+bool ip_parse_address(const char *str, uint16_t port, struct sockaddr_storage *addr)
+{
+    struct sockaddr_in *sin = (struct sockaddr_in *)addr;
+    struct sockaddr_in6 *sin6 = (struct sockaddr_in6 *)addr;
+    char buf[ADDRESS_STRLEN];
+    char *scope = NULL;
+    char *end = NULL;
+
+    memset(addr, '\0', sizeof(*addr));
+
+    if (inet_pton(AF_INET, str, &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        return true;
+    }
+
+    /* fe80::1%eth0 or fe80::1%2 */
+    snprintf(buf, sizeof(buf), "%s", str);
+    scope = strchr(buf, '%');
+    if (scope)
+        *scope++ = '\0';
+
+    if (inet_pton(AF_INET6, buf, &sin6->sin6_addr) != 1)
+        return false;
+
+    sin6->sin6_family = AF_INET6;
+    sin6->sin6_port = htons(port);
+    if (scope) {
+        sin6->sin6_scope_id = if_nametoindex(scope);
+        if (! sin6->sin6_scope_id)
+            sin6->sin6_scope_id = strtoul(scope, &end, 10);
+        if (! sin6->sin6_scope_id || (end && *end))
+            return false;
+    }
+
+    return true;
+}
+
+bool ip_format_address(const struct sockaddr_storage *addr, char *buf, size_t len)
+{
+    const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)addr;
+    size_t n;
+
+    switch (addr->ss_family) {
+        case AF_INET:
+            return inet_ntop(AF_INET, &((const struct sockaddr_in *)addr)->sin_addr, buf, len) != NULL;
+        case AF_INET6:
+            if (! inet_ntop(AF_INET6, &sin6->sin6_addr, buf, len))
+                return false;
+            if (! sin6->sin6_scope_id)
+                return true;
+            /* the interface index, unlike its name, still parses after the interface is gone */
+            n = strlen(buf);
+            return (size_t)snprintf(buf + n, len - n, "%%%u", sin6->sin6_scope_id) < len - n;
+        default:
+            return false;
+    }
+}
@@ -1,19 +1,23 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <math.h>
 #include <time.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <locale.h>
 #include <getopt.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 
 #include "matelight.h"
 
@@ -21,33 +25,84 @@ int grid_width = DEFAULT_GRID_WIDTH;
 int grid_height = DEFAULT_GRID_HEIGHT;
 bool grid_widescreen = true;
 static char *address = NULL;
-static int wled_port = 21324;
+static int wled_port = 0;
 static char *mdns_description = NULL;
 static char *joypad_dev = NULL;
 static bool joypad_udev = false;
 static bool keyboard = false;
 static int start_game = -1;
+static unsigned int seed = 0;
 static bool start_on_startup = false;
 static bool debug = false;
 static bool mqtt = false;
+static int fps = 0;
+static bool run_benchmark = false;
+static bool txtime = false;
+static int orientation = -1;
+static const char *display_spec = NULL;
+static double gamma_value = 1.0;
+static int white_balance[3] = { 100, 100, 100 };
+static const char *power_spec = NULL;
+static int white_percent = 100;
+static double white_exponent = 1.0;
+static const struct output_backend *backend = &wled_backend;
+static const char *tile_specs[MAX_OUTPUT_TARGETS] = { NULL };
+static size_t num_tiles = 0;
+static size_t num_tiles_without_address = 0;
+static const char *mirror_specs[MAX_OUTPUT_TARGETS] = { NULL };
+static size_t num_mirrors = 0;
+static bool mirrors_enabled = true;
+static char *shm_name = NULL;
+static char *capture_path = NULL;
+static char *verify_path = NULL;
+static struct capture_header capture_header = { 0 };
+
+// Indexed by ORIENT_*
+static const char *orientation_names[] = { "normal", "cw", "180", "ccw", "flip-h", "flip-v" };
 
 static struct sockaddr_storage udp_sockaddr = { 0 };
-static char wled_ip_new[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)] = { 0 };
+static char wled_ip_new[ADDRESS_STRLEN] = { 0 };
 const char *wled_ds = NULL;
-static int udp_fd = -1;
 
 static int joystick_cnt = 0;
 
-static double start_time_val = 0.0;
+static uint64_t start_time = 0;
+static uint64_t now = 0;
 double time_val = 0.0;
-static double last_tick_val = 0.0;
+double tick_phase = 0.0;
 int ticks = 0;
+static struct sched_timer *tick_timer = NULL;
+static struct sched_timer *frame_timer = NULL;
+
+struct frame_stats {
+    uint64_t frames;
+    uint64_t window_start;
+    uint64_t last_frame;
+    uint64_t intervals;
+    double interval_mean;
+    double interval_m2;
+    uint64_t interval_max;
+};
+
+static struct frame_stats frame_stats = { 0 };
+
+struct tick_stats {
+    uint64_t ticks;
+    uint64_t bursts;
+    uint64_t dropped;
+    uint64_t delayed;
+    uint64_t max_lag;
+};
 
 static bool display = false;
-//static char udp_data[65536];
-static char udp_data[2 + (MAX_GRID_SIZE * 3)] = { 0 };
+static char *frame = NULL;
 
-#define UDP_DATA_SIZE (2 + (grid_width * grid_height * 3))
+static const struct output_backend *backends[] = {
+    &wled_backend,
+    &ddp_backend,
+    &e131_backend,
+    &artnet_backend,
+};
 
 static const struct game *games[] = {
     &debug_game,
@@ -60,6 +115,7 @@ static const struct game *games[] = {
     &invaders_game,
 };
 static int cur_game = 0;
+static struct tick_stats tick_stats[ARRAY_LENGTH(games)];
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 static bool async_announce = false;
@@ -95,50 +151,110 @@ static const struct game *get_game(void)
     return games[cur_game];
 }
 
-static void handle_input(void)
+static int find_game(const char *name)
 {
-    int new_joystick_cnt = 0;
-    char text[100] = { 0 };
-    struct joystick *joystick = NULL;
+    size_t i;
 
-    while (read_joystick(&joystick)) {
-        if (joystick->last_key_idx == KEYPAD_SELECT && joystick->last_key_val && get_game()->playable && (! get_game()->non_interruptable)) {
-            if (get_game()->deactivate_func) {
-                get_game()->deactivate_func();
-            }
-            if (joystick->key_state & KEYPAD_START) {
-                fprintf(stderr, "starting debug game\n");
-                debug_game.activate_func(true);
-            } else {
-                do {
-                    cur_game++;
-                    cur_game %= ARRAY_LENGTH(games);
-                } while (! get_game()->playable);
-                if (get_game()->activate_func) {
-                    fprintf(stderr, "starting game: %s\n", get_game()->name);
-                    get_game()->activate_func(true);
-                }
-            }
+    for (i = 0; i < ARRAY_LENGTH(games); i++) {
+        if (strcmp(games[i]->name, name) == 0) {
+            return i;
         }
+    }
 
-        if (joystick_is_key_seq(joystick, konami_code, ARRAY_LENGTH(konami_code))) {
-            fprintf(stderr, "konami code activated\n");
-            if (get_game()->deactivate_func) {
-                get_game()->deactivate_func();
-            }
+    return -1;
+}
+
+static struct tick_stats *get_tick_stats(const struct game *game)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LENGTH(games); i++) {
+        if (games[i] == game) {
+            return &tick_stats[i];
+        }
+    }
+
+    return &tick_stats[0];
+}
+
+static void handle_joystick(struct joystick *joystick)
+{
+    if (joystick->last_key_idx == KEYPAD_SELECT && joystick->last_key_val && get_game()->playable && (! get_game()->non_interruptable)) {
+        if (get_game()->deactivate_func) {
+            get_game()->deactivate_func();
+        }
+        if (joystick->key_state & KEYPAD_START) {
+            fprintf(stderr, "starting debug game\n");
+            debug_game.activate_func(true);
+        } else {
+            do {
+                cur_game++;
+                cur_game %= ARRAY_LENGTH(games);
+            } while (! get_game()->playable);
             if (get_game()->activate_func) {
-                get_game()->activate_func(false);
+                fprintf(stderr, "starting game: %s\n", get_game()->name);
+                get_game()->activate_func(true);
             }
-            do_announce("HACK THE PLANET", COLOR_BLACK, COLOR_YELLOW, 10.0);
         }
+    }
 
-        if (get_game()->input_func) {
-            get_game()->input_func(joystick->player, joystick->last_key_idx, joystick->last_key_val, joystick->key_state);
+    if (joystick_is_key_seq(joystick, konami_code, ARRAY_LENGTH(konami_code))) {
+        fprintf(stderr, "konami code activated\n");
+        if (get_game()->deactivate_func) {
+            get_game()->deactivate_func();
+        }
+        if (get_game()->activate_func) {
+            get_game()->activate_func(false);
+        }
+        do_announce("HACK THE PLANET", COLOR_BLACK, COLOR_YELLOW, 10.0);
+    }
+
+    if (get_game()->input_func) {
+        get_game()->input_func(joystick->player, joystick->last_key_idx, joystick->last_key_val, joystick->key_state);
+    }
+}
+
+/* a capture records the joysticks whenever they change, a verify run gets them from there */
+static void update_joysticks(void)
+{
+    int players[MAX_JOYSTICKS];
+    size_t num_players;
+
+    if (verify_path) {
+        if (verify_joysticks(players, &num_players))
+            replay_joysticks(players, num_players);
+    } else if (capture_path) {
+        num_players = get_players(players, ARRAY_LENGTH(players));
+        capture_joysticks(players, num_players);
+    }
+}
+
+static void handle_input(void)
+{
+    int new_joystick_cnt = 0;
+    char text[100] = { 0 };
+    struct joystick *joystick = NULL;
+    int player, key_idx, key_state;
+    bool key_val;
+
+    if (verify_path) {
+        while (verify_input(&player, &key_idx, &key_val, &key_state)) {
+            joystick = replay_joystick(player, key_idx, key_val, key_state);
+            if (joystick)
+                handle_joystick(joystick);
+        }
+        update_joysticks();
+    } else {
+        while (read_joystick(&joystick)) {
+            capture_input(joystick);
+            handle_joystick(joystick);
         }
     }
 
     new_joystick_cnt = count_joysticks();
     if (joystick_cnt != new_joystick_cnt) {
+        if (! verify_path)
+            update_joysticks();
         if (new_joystick_cnt == 1) {
             snprintf(text, sizeof(text), "1 joypad");
         } else {
@@ -153,13 +269,6 @@ static void handle_input(void)
     }
 }
 
-static double get_time_val(void)
-{
-    struct timeval tv = { 0 };
-    gettimeofday(&tv, NULL);
-    return (double)tv.tv_sec + ((double)tv.tv_usec / 1000000.0);
-}
-
 void do_announce(const char *text, unsigned int color, unsigned int bgcolor, double speed)
 {
     if (get_game()->idle_func()) {
@@ -177,21 +286,17 @@ void do_announce(const char *text, unsigned int color, unsigned int bgcolor, dou
 
 void do_announce_my_ip(void)
 {
-    char wled_ip_address[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)] = { 0 };
-    char text[100 + MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN) + MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)] = { 0 };
+    char wled_ip_address[ADDRESS_STRLEN] = { 0 };
+    char text[100 + MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN) + ADDRESS_STRLEN] = { 0 };
+    char *scope = NULL;
 
-    if (udp_sockaddr.ss_family == AF_UNSPEC)
+    if (! ip_format_address(&udp_sockaddr, wled_ip_address, sizeof(wled_ip_address)))
         return;
 
-    if (udp_sockaddr.ss_family == AF_INET) {
-        if (! inet_ntop(AF_INET, &((struct sockaddr_in *)&udp_sockaddr)->sin_addr, wled_ip_address, sizeof(wled_ip_address)))
-            return;
-    } else if (udp_sockaddr.ss_family == AF_INET6) {
-        if (! inet_ntop(AF_INET6, &((struct sockaddr_in6 *)&udp_sockaddr)->sin6_addr, wled_ip_address, sizeof(wled_ip_address)))
-            return;
-    } else {
-        return;
-    }
+    /* the scope means nothing to whoever reads the wall */
+    scope = strchr(wled_ip_address, '%');
+    if (scope)
+        *scope = '\0';
 
     snprintf(text, sizeof(text), "RPI: %s, WLED: %s", ip_address, wled_ip_address);
     do_announce(text, COLOR_BLUE, COLOR_BLACK, 10.0);
@@ -214,6 +319,8 @@ void do_announce_async(char *text, unsigned int color, unsigned int bgcolor, dou
     async_announce_speed = speed;
 
     (void)pthread_mutex_unlock(&mutex);
+
+    event_notify();
 }
 
 static void handle_announce_async(void)
@@ -221,11 +328,16 @@ static void handle_announce_async(void)
     if (pthread_mutex_lock(&mutex) != 0)
         return;
 
+    if (verify_path && ! async_announce)
+        async_announce = verify_announce(&async_announce_text, &async_announce_color, &async_announce_bgcolor, &async_announce_speed);
+
     if (! async_announce) {
         (void)pthread_mutex_unlock(&mutex);
         return;
     }
 
+    capture_announce(async_announce_text, async_announce_color, async_announce_bgcolor, async_announce_speed);
+
     do_announce(async_announce_text, async_announce_color, async_announce_bgcolor, async_announce_speed);
 
     async_announce = false;
@@ -248,58 +360,38 @@ void update_wled_ip(const char *address)
     wled_ip_new[sizeof(wled_ip_new) - 1] = '\0';
 
     (void)pthread_mutex_unlock(&mutex);
+
+    event_notify();
 }
 
 static void handle_wled_ip_async(void)
 {
-    int af = AF_UNSPEC;
-    struct in_addr addr;
-    struct in6_addr addr6;
-    bool update = false;
+    struct sockaddr_storage addr;
 
     if (pthread_mutex_lock(&mutex) != 0)
         return;
 
+    if (verify_path)
+        (void)verify_wled_ip(wled_ip_new, sizeof(wled_ip_new));
+
     if (! *wled_ip_new) {
         (void)pthread_mutex_unlock(&mutex);
         return;
     }
 
-    if (inet_pton(AF_INET, wled_ip_new, &addr)) {
-        af = AF_INET;
-    } else if (inet_pton(AF_INET6, wled_ip_new, &addr6)) {
-        af = AF_INET6;
-    } else {
+    capture_wled_ip(wled_ip_new);
+
+    if (! ip_parse_address(wled_ip_new, wled_port, &addr)) {
         *wled_ip_new = '\0';
         (void)pthread_mutex_unlock(&mutex);
         return;
     }
 
-    if (af != udp_sockaddr.ss_family) {
-        if (af == AF_INET) {
-            udp_sockaddr.ss_family = AF_INET;
-            ((struct sockaddr_in *)&udp_sockaddr)->sin_addr = addr;
-            ((struct sockaddr_in *)&udp_sockaddr)->sin_port = htons(wled_port);
-        } else if (af == AF_INET6) {
-            udp_sockaddr.ss_family = AF_INET6;
-            ((struct sockaddr_in6 *)&udp_sockaddr)->sin6_addr = addr6;
-            ((struct sockaddr_in6 *)&udp_sockaddr)->sin6_port = htons(wled_port);
-        }
-        update = true;
-    } else if (af == AF_INET && memcmp(&addr, &((struct sockaddr_in *)&udp_sockaddr)->sin_addr, sizeof(addr))) {
-        udp_sockaddr.ss_family = AF_INET;
-        memcpy(&((struct sockaddr_in *)&udp_sockaddr)->sin_addr, &addr, sizeof(addr));
-        ((struct sockaddr_in *)&udp_sockaddr)->sin_port = htons(wled_port);
-        update = true;
-    } else if (af == AF_INET6 && memcmp(&addr6, &((struct sockaddr_in6 *)&udp_sockaddr)->sin6_addr, sizeof(addr6))) {
-        udp_sockaddr.ss_family = AF_INET6;
-        memcpy(&((struct sockaddr_in6 *)&udp_sockaddr)->sin6_addr, &addr6, sizeof(addr6));
-        ((struct sockaddr_in6 *)&udp_sockaddr)->sin6_port = htons(wled_port);
-        update = true;
-    }
-
-    if (update) {
+    /* a link-local address found on another interface is another controller */
+    if (memcmp(&addr, &udp_sockaddr, sizeof(addr)) != 0) {
+        memcpy(&udp_sockaddr, &addr, sizeof(udp_sockaddr));
         fprintf(stderr, "using wled controller from mdns: %s\n", wled_ip_new);
+        tx_reset();
         do_announce_my_ip();
     }
 
@@ -307,6 +399,355 @@ static void handle_wled_ip_async(void)
     (void)pthread_mutex_unlock(&mutex);
 }
 
+static struct sched_timer *get_tick_timer(void)
+{
+    if (get_game()->tick_freq <= 0.0 || get_game()->tick_freq > 1.0)
+        return NULL;
+
+    /* an idle game doesn't need any wakeups until there is input */
+    if (get_game()->idle_func())
+        return NULL;
+
+    return sched_timer_get(SCHED_NSEC(get_game()->tick_freq));
+}
+
+static void update_tick_timer(void)
+{
+    struct sched_timer *timer = get_tick_timer();
+
+    if (timer == tick_timer)
+        return;
+
+    /* no ticks are run while the game is idle, so start over instead of catching up */
+    sched_timer_stop(tick_timer);
+    tick_timer = timer;
+    sched_timer_start(tick_timer, now);
+}
+
+static void handle_ticks(void)
+{
+    const struct game *game = get_game();
+    struct tick_stats *stats = get_tick_stats(game);
+    int max_catchup = game->max_catchup > 0 ? game->max_catchup : 1;
+    int n = 0;
+    uint64_t lag;
+
+    update_tick_timer();
+
+    lag = sched_timer_lag(tick_timer, now);
+    if (lag > stats->max_lag)
+        stats->max_lag = lag;
+
+    while (n < max_catchup && get_game() == game && sched_timer_expired(tick_timer, now)) {
+        n++;
+        ticks++;
+        stats->ticks++;
+        if (game->tick_func) {
+            game->tick_func();
+        }
+    }
+
+    if (n > 1)
+        stats->bursts++;
+
+    /* bounded catch-up, a stalled loop must not turn into a fast-forward burst,
+     * a slow game's ticks move later instead, so it loses time but no ticks */
+    if (get_game() == game && sched_timer_due(tick_timer, now)) {
+        if (game->catchup_policy == CATCHUP_SLOW) {
+            stats->delayed += sched_timer_delay(tick_timer, now);
+        } else {
+            stats->dropped += sched_timer_skip(tick_timer, now);
+        }
+    }
+}
+
+static void update_frame_timer(void)
+{
+    if (get_game()->idle_func()) {
+        /* the pause until the next game isn't frame time jitter */
+        frame_stats.last_frame = 0;
+        sched_timer_stop(frame_timer);
+    } else if (frame_timer && ! sched_timer_running(frame_timer)) {
+        sched_timer_start(frame_timer, now);
+    }
+}
+
+static bool frame_due(void)
+{
+    bool due = false;
+
+    /* without a fixed frame rate a frame is rendered after every tick or input */
+    if (! frame_timer)
+        return true;
+
+    update_frame_timer();
+
+    /* missed frames are dropped, only the latest state is worth showing */
+    while (sched_timer_expired(frame_timer, now)) {
+        due = true;
+    }
+
+    return due;
+}
+
+static void update_frame_stats(bool shown)
+{
+    uint64_t interval;
+    double delta;
+
+    if (! shown) {
+        frame_stats.last_frame = 0;
+        return;
+    }
+
+    frame_stats.frames++;
+
+    if (frame_stats.last_frame) {
+        interval = now - frame_stats.last_frame;
+        frame_stats.intervals++;
+        delta = (double)interval - frame_stats.interval_mean;
+        frame_stats.interval_mean += delta / (double)frame_stats.intervals;
+        frame_stats.interval_m2 += delta * ((double)interval - frame_stats.interval_mean);
+        if (interval > frame_stats.interval_max)
+            frame_stats.interval_max = interval;
+    }
+
+    frame_stats.last_frame = now;
+}
+
+static void render_frame(void)
+{
+    tick_phase = sched_timer_phase(tick_timer, now);
+
+    /* the game state is current when frames are only rendered after ticks */
+    if (get_game()->interpolate_func) {
+        get_game()->interpolate_func(frame_timer ? tick_phase : 1.0);
+    }
+
+    display = false;
+    if (get_game()->render_func) {
+        get_game()->render_func(&display, frame);
+    }
+    if (display && verify_path) {
+        verify_frame(frame);
+    } else if (display) {
+        tx_frame(&udp_sockaddr, frame, sched_timer_last_deadline(frame_timer));
+        shm_frame(frame, now);
+        capture_frame(frame);
+    }
+
+    update_frame_stats(display);
+}
+
+static void print_stats(void)
+{
+    size_t i;
+    double window;
+    double jitter = 0.0;
+
+    window = (double)(now - frame_stats.window_start) / (double)SCHED_NSEC_PER_SEC;
+    if (frame_stats.intervals > 1)
+        jitter = sqrt(frame_stats.interval_m2 / (double)(frame_stats.intervals - 1));
+
+    fprintf(stderr, "stats: %.1f secs, game: %s, ticks: %d\n", window, get_game()->name, ticks);
+    for (i = 0; i < ARRAY_LENGTH(games); i++) {
+        if (! tick_stats[i].ticks && ! tick_stats[i].dropped)
+            continue;
+        fprintf(stderr, "stats: game: %s, ticks: %" PRIu64 ", catch-up bursts: %" PRIu64 ", dropped ticks: %" PRIu64 ", delayed: %" PRIu64 ", max lag: %.2f ms\n",
+                games[i]->name,
+                tick_stats[i].ticks,
+                tick_stats[i].bursts,
+                tick_stats[i].dropped,
+                tick_stats[i].delayed,
+                (double)tick_stats[i].max_lag / 1000000.0);
+    }
+    fprintf(stderr, "stats: frames: %" PRIu64 ", target rate: %d fps, frame rate: %.2f fps, frame interval: %.2f ms, jitter: %.3f ms, max interval: %.2f ms\n",
+            frame_stats.frames,
+            fps,
+            frame_stats.interval_mean > 0.0 ? (double)SCHED_NSEC_PER_SEC / frame_stats.interval_mean : 0.0,
+            frame_stats.interval_mean / 1000000.0,
+            jitter / 1000000.0,
+            (double)frame_stats.interval_max / 1000000.0);
+    tx_print_stats();
+
+    /* every report covers the time since the previous one */
+    memset(tick_stats, '\0', sizeof(tick_stats));
+    memset(&frame_stats, '\0', sizeof(frame_stats));
+    frame_stats.window_start = now;
+}
+
+static void mirror_event(int fd, unsigned int events, void *arg)
+{
+    struct signalfd_siginfo info;
+
+    (void)events;
+    (void)arg;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        mirrors_enabled = ! mirrors_enabled;
+        fprintf(stderr, "mirrors %s\n", mirrors_enabled ? "enabled" : "disabled");
+        tx_enable_mirrors(mirrors_enabled);
+    }
+}
+
+static void stats_event(int fd, unsigned int events, void *arg)
+{
+    struct signalfd_siginfo info;
+
+    (void)events;
+    (void)arg;
+
+    while (read(fd, &info, sizeof(info)) == sizeof(info)) {
+        now = sched_now();
+        print_stats();
+    }
+}
+
+static bool parse_address(char *str, struct sockaddr_storage *addr)
+{
+    char *port = NULL;
+    char *end = NULL;
+
+    /* address[:port], an IPv6 address with a port goes in brackets: [fe80::1%eth0]:21324 */
+    if (*str == '[') {
+        end = strchr(++str, ']');
+        if (! end || (end[1] && end[1] != ':'))
+            return false;
+        *end++ = '\0';
+        if (*end)
+            port = end + 1;
+    } else if (strchr(str, ':') == strrchr(str, ':')) {
+        port = strchr(str, ':');
+        if (port)
+            *port++ = '\0';
+    }
+
+    return ip_parse_address(str, port ? atoi(port) : wled_port, addr);
+}
+
+static int find_orientation(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LENGTH(orientation_names); i++) {
+        if (strcmp(orientation_names[i], name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static bool parse_tile(const char *tile_spec)
+{
+    char buf[128] = { 0 };
+    char *spec = buf;
+    struct sockaddr_storage addr = { 0 };
+    char *fields[7] = { NULL };
+    char *field = NULL;
+    int tile_orientation = ORIENT_NORMAL;
+    bool rgbw = false;
+    size_t num_fields = 0;
+
+    strncpy(buf, tile_spec, sizeof(buf) - 1);
+
+    /* x,y,width,height[,address[:port][,orientation[,rgbw]]] */
+    while ((field = strsep(&spec, ",")) != NULL) {
+        if (num_fields >= ARRAY_LENGTH(fields))
+            return false;
+        fields[num_fields++] = field;
+    }
+    if (num_fields < 4)
+        return false;
+
+    addr.ss_family = AF_UNSPEC;
+    if (num_fields > 4 && *fields[4]) {
+        if (! parse_address(fields[4], &addr))
+            return false;
+    } else {
+        num_tiles_without_address++;
+    }
+
+    if (num_fields > 5 && *fields[5]) {
+        tile_orientation = find_orientation(fields[5]);
+        if (tile_orientation == -1)
+            return false;
+    }
+
+    if (num_fields > 6) {
+        if (strcmp(fields[6], "rgbw") != 0)
+            return false;
+        rgbw = true;
+    }
+
+    return output_add_tile(atoi(fields[0]), atoi(fields[1]), atoi(fields[2]), atoi(fields[3]), &addr, tile_orientation, rgbw);
+}
+
+static bool parse_display(const char *spec)
+{
+    char filter_name[16] = { 0 };
+    int width, height;
+    int filter = SCALE_NEAREST;
+
+    /* widthxheight[,filter] */
+    switch (sscanf(spec, "%dx%d,%15s", &width, &height, filter_name)) {
+        case 3:
+            filter = scale_find(filter_name);
+            if (filter == -1)
+                return false;
+            break;
+        case 2:
+            break;
+        default:
+            return false;
+    }
+
+    if (width < 1 || width > MAX_GRID_WIDTH || height < 1 || height > MAX_GRID_HEIGHT)
+        return false;
+
+    output_set_scale(width, height, filter);
+    return true;
+}
+
+static bool parse_power(const char *spec)
+{
+    int budget = 0;
+    int channel = POWER_CHANNEL_MA;
+    int idle = POWER_IDLE_MA;
+
+    /* mA[,mA per channel[,idle mA per LED]] */
+    if (sscanf(spec, "%d,%d,%d", &budget, &channel, &idle) < 1)
+        return false;
+    if (budget < 1 || channel < 1 || idle < 0)
+        return false;
+
+    power_init(budget, channel, idle);
+    return true;
+}
+
+static bool parse_mirror(const char *mirror_spec)
+{
+    char buf[128] = { 0 };
+    char *spec = buf;
+    char *address = NULL;
+    struct sockaddr_storage addr = { 0 };
+    int max_fps = 0;
+
+    strncpy(buf, mirror_spec, sizeof(buf) - 1);
+
+    /* address[:port][,fps] */
+    address = strsep(&spec, ",");
+    if (! parse_address(address, &addr))
+        return false;
+
+    if (spec) {
+        max_fps = atoi(spec);
+        if (max_fps < 1 || max_fps > MAX_FPS)
+            return false;
+    }
+
+    return output_add_mirror(&addr, max_fps);
+}
+
 static void usage(void)
 {
     fprintf(stderr, "Usage: matelight [options]\n");
@@ -315,6 +756,7 @@ static void usage(void)
     fprintf(stderr, "  -H, --height\t\t\tgrid height\n");
     fprintf(stderr, "  -a, --address\t\t\tWLED address\n");
     fprintf(stderr, "  -p, --port\t\t\tWLED port\n");
+    fprintf(stderr, "  -P, --protocol\t\twled, ddp, e131 or artnet\n");
     fprintf(stderr, "  -m, --mdns-description\tWLED MDNS description\n");
     fprintf(stderr, "  -j, --joystick-device\t\tjoystick device\n");
     fprintf(stderr, "  -u, --udev-hotplug\t\thotpluggable joystick devices\n");
@@ -323,6 +765,23 @@ static void usage(void)
     fprintf(stderr, "  -d, --debug\t\t\tdebug mode\n");
     fprintf(stderr, "  -S, --start\t\t\tstart game on startup\n");
     fprintf(stderr, "  -M, --mqtt\t\t\tenable MQTT\n");
+    fprintf(stderr, "  -F, --fps\t\t\toutput frame rate\n");
+    fprintf(stderr, "  -T, --tile\t\t\tx,y,width,height[,address[:port][,orientation[,rgbw]]]\n");
+    fprintf(stderr, "  -R, --mirror\t\t\taddress[:port][,fps]\n");
+    fprintf(stderr, "  -D, --display\t\t\twidthxheight[,nearest|block|box], scale the grid to a display of this size\n");
+    fprintf(stderr, "  -O, --orientation\t\thow the display is mounted: normal, cw, 180, ccw, flip-h or flip-v\n");
+    fprintf(stderr, "  -G, --gamma\t\t\tcolor gamma, 2.2 for most LEDs\n");
+    fprintf(stderr, "  -b, --brightness\t\tbrightness in percent\n");
+    fprintf(stderr, "  -w, --white-balance\t\tred,green,blue in percent\n");
+    fprintf(stderr, "  -E, --dither\t\t\ttemporal dithering of the corrected colors\n");
+    fprintf(stderr, "  -r, --rgbw\t\t\tRGBW controller, [percent of the common color to white[,exponent]]\n");
+    fprintf(stderr, "  -l, --power-limit\t\tmA[,mA per channel[,idle mA per LED]]\n");
+    fprintf(stderr, "  -L, --led-map\t\t\trows, serpentine or a LED map file\n");
+    fprintf(stderr, "  -s, --shm\t\t\tshared memory name for local consumers\n");
+    fprintf(stderr, "  -C, --capture\t\t\trecord input and frames to a file\n");
+    fprintf(stderr, "  -V, --verify\t\t\treplay a capture and compare the frames\n");
+    fprintf(stderr, "  -t, --txtime\t\t\tsend frames with SO_TXTIME\n");
+    fprintf(stderr, "  -B, --benchmark\t\tbenchmark frame output and exit\n");
     fprintf(stderr, "  -h, --help\t\t\thelp\n");
     exit(EXIT_FAILURE);
 }
@@ -332,6 +791,7 @@ static struct option long_options[] = {
     {"height",              required_argument,  NULL,   'H'},
     {"address",             required_argument,  NULL,   'a'},
     {"port",                required_argument,  NULL,   'p'},
+    {"protocol",            required_argument,  NULL,   'P'},
     {"mdns-description",    required_argument,  NULL,   'm'},
     {"joystick-device",     required_argument,  NULL,   'j'},
     {"udev-hotplug",        no_argument,        NULL,   'u'},
@@ -340,6 +800,23 @@ static struct option long_options[] = {
     {"start",               no_argument,        NULL,   'S'},
     {"debug",               no_argument,        NULL,   'd'},
     {"mqtt",                no_argument,        NULL,   'M'},
+    {"fps",                 required_argument,  NULL,   'F'},
+    {"tile",                required_argument,  NULL,   'T'},
+    {"mirror",              required_argument,  NULL,   'R'},
+    {"display",             required_argument,  NULL,   'D'},
+    {"orientation",         required_argument,  NULL,   'O'},
+    {"gamma",               required_argument,  NULL,   'G'},
+    {"brightness",          required_argument,  NULL,   'b'},
+    {"white-balance",       required_argument,  NULL,   'w'},
+    {"dither",              no_argument,        NULL,   'E'},
+    {"rgbw",                optional_argument,  NULL,   'r'},
+    {"power-limit",         required_argument,  NULL,   'l'},
+    {"led-map",             required_argument,  NULL,   'L'},
+    {"shm",                 required_argument,  NULL,   's'},
+    {"capture",             required_argument,  NULL,   'C'},
+    {"verify",              required_argument,  NULL,   'V'},
+    {"txtime",              no_argument,        NULL,   't'},
+    {"benchmark",           no_argument,        NULL,   'B'},
     {"help",                no_argument,        NULL,   'h'},
     {NULL,                  0,                  NULL,   0}
 };
@@ -350,7 +827,7 @@ int main(int argc, char *argv[])
     size_t i;
 
     for (;;) {
-        c = getopt_long(argc, argv, "W:H:a:p:m:j:ukg:dSMh", long_options, NULL);
+        c = getopt_long(argc, argv, "W:H:a:p:P:m:j:ukg:dSMF:T:R:D:O:G:b:w:Er::l:L:s:C:V:tBh", long_options, NULL);
         if (c == -1)
             break;
 
@@ -383,6 +860,20 @@ int main(int argc, char *argv[])
                 }
                 break;
 
+            case 'P':
+                backend = NULL;
+                for (i = 0; i < ARRAY_LENGTH(backends); i++) {
+                    if (strcmp(backends[i]->name, optarg) == 0) {
+                        backend = backends[i];
+                        break;
+                    }
+                }
+                if (! backend) {
+                    fprintf(stderr, "Protocol \"%s\" not found.\n", optarg);
+                    usage();
+                }
+                break;
+
             case 'm':
                 mdns_description = optarg;
                 break;
@@ -400,13 +891,7 @@ int main(int argc, char *argv[])
                 break;
 
             case 'g':
-                start_game = -1;
-                for (i = 0; i < ARRAY_LENGTH(games); i++) {
-                    if (strcmp(games[i]->name, optarg) == 0) {
-                        start_game = i;
-                        break;
-                    }
-                }
+                start_game = find_game(optarg);
                 if (start_game == -1) {
                     fprintf(stderr, "Game \"%s\" not found.\n", optarg);
                     usage();
@@ -425,6 +910,113 @@ int main(int argc, char *argv[])
                 mqtt = true;
                 break;
 
+            case 'F':
+                fps = atoi(optarg);
+                if (fps < 1 || fps > MAX_FPS) {
+                    fprintf(stderr, "Frame rate must be within 1 and %d\n", MAX_FPS);
+                    usage();
+                }
+                break;
+
+            case 'T':
+                if (num_tiles >= ARRAY_LENGTH(tile_specs)) {
+                    fprintf(stderr, "At most %d tiles can be used\n", MAX_OUTPUT_TARGETS);
+                    usage();
+                }
+                tile_specs[num_tiles++] = optarg;
+                break;
+
+            case 'R':
+                if (num_mirrors >= ARRAY_LENGTH(mirror_specs)) {
+                    fprintf(stderr, "At most %d mirrors can be used\n", MAX_OUTPUT_TARGETS);
+                    usage();
+                }
+                mirror_specs[num_mirrors++] = optarg;
+                break;
+
+            case 'D':
+                display_spec = optarg;
+                break;
+
+            case 'O':
+                orientation = find_orientation(optarg);
+                if (orientation == -1) {
+                    fprintf(stderr, "Orientation \"%s\" not found.\n", optarg);
+                    usage();
+                }
+                break;
+
+            case 'G':
+                gamma_value = atof(optarg);
+                if (gamma_value < 0.1 || gamma_value > 5.0) {
+                    fprintf(stderr, "Gamma must be within 0.1 and 5.0\n");
+                    usage();
+                }
+                break;
+
+            case 'b':
+                if (atoi(optarg) < 0 || atoi(optarg) > 100) {
+                    fprintf(stderr, "Brightness must be within 0 and 100\n");
+                    usage();
+                }
+                color_set_brightness(atoi(optarg));
+                break;
+
+            case 'w':
+                if (sscanf(optarg, "%d,%d,%d", &white_balance[0], &white_balance[1], &white_balance[2]) != 3 ||
+                    white_balance[0] < 0 || white_balance[0] > 100 ||
+                    white_balance[1] < 0 || white_balance[1] > 100 ||
+                    white_balance[2] < 0 || white_balance[2] > 100) {
+                    fprintf(stderr, "White balance must be red,green,blue within 0 and 100\n");
+                    usage();
+                }
+                break;
+
+            case 'E':
+                color_enable_dither(true);
+                break;
+
+            case 'r':
+                /* tiles take the curve as well, without --rgbw it's all of the common color */
+                output_set_rgbw(true);
+                if (optarg && (sscanf(optarg, "%d,%lf", &white_percent, &white_exponent) < 1 ||
+                               white_percent < 0 || white_percent > 100 || white_exponent < 0.1 || white_exponent > 5.0)) {
+                    fprintf(stderr, "RGBW must be a percentage within 0 and 100 and an exponent within 0.1 and 5.0\n");
+                    usage();
+                }
+                break;
+
+            case 'l':
+                power_spec = optarg;
+                break;
+
+            case 'L':
+                if (! output_set_led_map(optarg)) {
+                    fprintf(stderr, "Invalid LED map \"%s\"\n", optarg);
+                    usage();
+                }
+                break;
+
+            case 's':
+                shm_name = optarg;
+                break;
+
+            case 'C':
+                capture_path = optarg;
+                break;
+
+            case 'V':
+                verify_path = optarg;
+                break;
+
+            case 't':
+                txtime = true;
+                break;
+
+            case 'B':
+                run_benchmark = true;
+                break;
+
             case 'h':
             case '?':
             default:
@@ -436,74 +1028,219 @@ int main(int argc, char *argv[])
     if (optind < argc)
         usage();
 
+    output_set_backend(backend);
+    if (! wled_port)
+        wled_port = backend->port;
+
+    if (capture_path && verify_path) {
+        fprintf(stderr, "Either capture or verify can be used.\n");
+        usage();
+    }
+
+    if (run_benchmark) {
+        benchmark();
+        exit(EXIT_SUCCESS);
+    }
+
+    /* a verify run is the captured session again, whatever the options say */
+    if (verify_path) {
+        verify_init(verify_path, &capture_header);
+        capture_header.game[sizeof(capture_header.game) - 1] = '\0';
+        start_game = -1;
+        if (*capture_header.game) {
+            start_game = find_game(capture_header.game);
+            if (start_game == -1) {
+                fprintf(stderr, "Game \"%s\" of the capture not found.\n", capture_header.game);
+                exit(EXIT_FAILURE);
+            }
+        }
+        fps = capture_header.fps;
+        if (fps < 0 || fps > MAX_FPS) {
+            fprintf(stderr, "Invalid frame rate %d in the capture\n", fps);
+            exit(EXIT_FAILURE);
+        }
+        start_on_startup = capture_header.start_on_startup;
+        debug = capture_header.debug;
+        seed = capture_header.seed;
+    }
+
     grid_widescreen = (grid_width > grid_height || (grid_width >= 16 && grid_height >= 10));
 
-    if (! address && ! mdns_description) {
+    /* without tiles the display takes one of the output targets */
+    if ((num_tiles ? num_tiles : 1) + num_mirrors > MAX_OUTPUT_TARGETS) {
+        fprintf(stderr, "At most %d outputs can be used, every tile and mirror counts, and the display too without tiles\n", MAX_OUTPUT_TARGETS);
+        usage();
+    }
+
+    /* the port may be given after the tiles */
+    for (i = 0; i < num_tiles; i++) {
+        if (! parse_tile(tile_specs[i])) {
+            fprintf(stderr, "Invalid tile \"%s\"\n", tile_specs[i]);
+            usage();
+        }
+    }
+
+    color_init(gamma_value, white_balance[0], white_balance[1], white_balance[2]);
+    rgbw_init(white_percent, white_exponent);
+
+    if (power_spec && ! parse_power(power_spec)) {
+        fprintf(stderr, "Invalid power limit \"%s\"\n", power_spec);
+        usage();
+    }
+
+    if (display_spec && ! parse_display(display_spec)) {
+        fprintf(stderr, "Invalid display \"%s\"\n", display_spec);
+        usage();
+    }
+
+    /* tiles are mounted one by one */
+    if (orientation != -1 && num_tiles) {
+        fprintf(stderr, "Either orientation or tiles can be used, tiles take their own orientation.\n");
+        usage();
+    }
+    if (orientation != -1)
+        output_set_orientation(orientation);
+
+    for (i = 0; i < num_mirrors; i++) {
+        if (! parse_mirror(mirror_specs[i])) {
+            fprintf(stderr, "Invalid mirror \"%s\"\n", mirror_specs[i]);
+            usage();
+        }
+    }
+
+    if (! verify_path && ! address && ! mdns_description && (! num_tiles || num_tiles_without_address)) {
         fprintf(stderr, "Either WLED address or WLED MDNS description must be specified.\n");;
         usage();
     }
 
-    if ((joypad_dev && joypad_udev) || (joypad_dev && keyboard) || (joypad_udev && keyboard)) {
+    if (! verify_path && ((joypad_dev && joypad_udev) || (joypad_dev && keyboard) || (joypad_udev && keyboard))) {
         fprintf(stderr, "Either joystick device, hotpluggable joystick mode or keyboard mode must be used.\n");;
         usage();
     }
 
-    if (! joypad_dev && ! joypad_udev && ! keyboard) {
+    if (! verify_path && ! joypad_dev && ! joypad_udev && ! keyboard) {
         fprintf(stderr, "Either joystick device, hotpluggable joystick mode or keyboard mode must be used.\n");;
         usage();
     }
 
     fprintf(stderr, "starting matelight controller\n");
-    fprintf(stderr, "grid resolution: %d x %d, grid type: %s\n", grid_width, grid_height, grid_widescreen ? "widescreen" : "highscreen");
+    fprintf(stderr, "grid resolution: %d x %d, grid type: %s, orientation: %s\n", grid_width, grid_height, grid_widescreen ? "widescreen" : "highscreen",
+            orientation_names[orientation != -1 ? orientation : ORIENT_NORMAL]);
 
     (void)setlocale(LC_ALL, "C.UTF-8");
 
-    srand(time(NULL));
+    frame = calloc(grid_width * grid_height, 3);
+    if (! frame) {
+        perror("calloc");
+        exit(EXIT_FAILURE);
+    }
+
+    if (shm_name) {
+        shm_init(shm_name);
+    }
+
+    if (! verify_path)
+        seed = time(NULL);
+    srand(seed);
+
+    event_init();
+
+    if (! event_add_signal(SIGUSR1, stats_event, NULL)) {
+        exit(EXIT_FAILURE);
+    }
+
+    if (num_mirrors && ! event_add_signal(SIGUSR2, mirror_event, NULL)) {
+        exit(EXIT_FAILURE);
+    }
 
     memset(&udp_sockaddr, '\0', sizeof(udp_sockaddr));
     udp_sockaddr.ss_family = AF_UNSPEC;
-    if (address) {
-        udp_sockaddr.ss_family = AF_INET;
-        ((struct sockaddr_in *)&udp_sockaddr)->sin_port = htons(wled_port);
-        ((struct sockaddr_in *)&udp_sockaddr)->sin_addr.s_addr = inet_addr(address);
+    if (verify_path) {
+        /* only for announcing it, nothing is sent */
+        if (! ip_parse_address(capture_header.wled_address, wled_port, &udp_sockaddr))
+            udp_sockaddr.ss_family = AF_UNSPEC;
+    } else if (address) {
+        if (! ip_parse_address(address, wled_port, &udp_sockaddr)) {
+            fprintf(stderr, "Invalid WLED address: %s\n", address);
+            exit(EXIT_FAILURE);
+        }
     } else {
         wled_ds = mdns_description;
     }
 
-    udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (udp_fd == -1) {
-        perror("socket");
-        exit(EXIT_FAILURE);
-    }
-
     input_reset();
-    if (joypad_dev) {
-        init_joystick(joypad_dev);
-    } else if (joypad_udev) {
-        init_udev_hotplug();
+    if (verify_path) {
+        /* nothing leaves or enters a verify run */
+        snprintf(ip_address, sizeof(ip_address), "%s", capture_header.ip_address);
     } else {
-        init_keyboard();
-    }
-    joystick_cnt = count_joysticks();
+        output_init();
+        tx_init(txtime);
 
-    ip_init();
-    fprintf(stderr, "my IP-address is: %s\n", ip_address);
-    if (wled_ds) {
-        mdns_init();
-    }
-    if (mqtt) {
-        mqtt_init();
+        if (joypad_dev) {
+            init_joystick(joypad_dev);
+        } else if (joypad_udev) {
+            init_udev_hotplug();
+        } else {
+            init_keyboard();
+        }
+
+        ip_init();
+        fprintf(stderr, "my IP-address is: %s\n", ip_address);
+        if (wled_ds) {
+            mdns_init();
+        }
+        if (mqtt) {
+            mqtt_init();
+        }
     }
 
     for (i = 0; i < ARRAY_LENGTH(games); i++) {
         if (games[i]->init_func) {
             games[i]->init_func();
         }
+        if (games[i]->tick_freq > 0.0 && games[i]->tick_freq <= 1.0) {
+            if (! sched_timer_get(SCHED_NSEC(games[i]->tick_freq))) {
+                exit(EXIT_FAILURE);
+            }
+        }
     }
 
-    start_time_val = get_time_val();
-    last_tick_val = 0.0;
+    if (fps) {
+        frame_timer = sched_timer_new(SCHED_NSEC_PER_SEC / fps);
+        if (! frame_timer) {
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (verify_path) {
+        start_time = capture_header.start_time;
+    } else {
+        start_time = sched_now();
+    }
+
+    if (capture_path) {
+        memcpy(capture_header.magic, CAPTURE_MAGIC, sizeof(capture_header.magic));
+        capture_header.version = CAPTURE_VERSION;
+        capture_header.width = grid_width;
+        capture_header.height = grid_height;
+        capture_header.fps = fps;
+        if (start_game != -1)
+            snprintf(capture_header.game, sizeof(capture_header.game), "%s", games[start_game]->name);
+        capture_header.start_on_startup = start_on_startup;
+        capture_header.debug = debug;
+        capture_header.seed = seed;
+        capture_header.start_time = start_time;
+        snprintf(capture_header.ip_address, sizeof(capture_header.ip_address), "%s", ip_address);
+        (void)ip_format_address(&udp_sockaddr, capture_header.wled_address, sizeof(capture_header.wled_address));
+        capture_init(capture_path, &capture_header);
+    }
+
+    update_joysticks();
+    joystick_cnt = count_joysticks();
+
+    now = start_time;
     ticks = 0;
+    frame_stats.window_start = now;
 
     cur_game = 0;
     if (start_game != -1)
@@ -527,33 +1264,32 @@ int main(int argc, char *argv[])
     }
 
     for (;;) {
+        if (verify_path) {
+            if (! verify_step(&now))
+                break;
+        } else {
+            now = sched_now();
+            capture_step(now);
+        }
+        time_val = (double)(now - start_time) / (double)SCHED_NSEC_PER_SEC;
+
         handle_input();
         handle_announce_async();
         handle_wled_ip_async();
 
-        time_val = get_time_val() - start_time_val;
-        if (get_game()->tick_freq > 0.0 && get_game()->tick_freq <= 1.0) {
-            while (time_val >= (last_tick_val + get_game()->tick_freq)) {
-                last_tick_val += get_game()->tick_freq;
-                ticks++;
-                if (get_game()->tick_func) {
-                    get_game()->tick_func();
-                }
-            }
-        }
+        handle_ticks();
 
-        display = false;
-        if (get_game()->render_func) {
-            udp_data[0] = WLED_DRGB;
-            udp_data[1] = DISPLAY_TIMEOUT;
-            get_game()->render_func(&display, udp_data + 2);
-        }
-        if (display) {
-            if (udp_sockaddr.ss_family != AF_UNSPEC) {
-                (void)sendto(udp_fd, udp_data, UDP_DATA_SIZE, 0, (struct sockaddr *)&udp_sockaddr, sizeof(udp_sockaddr));
-            }
+        if (frame_due()) {
+            render_frame();
         }
 
-        usleep(100000);
+        update_tick_timer();
+        update_frame_timer();
+
+        /* sleep until input, a tick is due or the mqtt/mdns threads have something for us */
+        if (! verify_path)
+            (void)event_wait(input_timeout());
     }
+
+    exit(verify_finish() ? EXIT_SUCCESS : EXIT_FAILURE);
 }
@@ -3,7 +3,9 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <netinet/in.h>
+#include <net/if.h>
 #include <linux/limits.h>
 
 #define ARRAY_LENGTH(array) (sizeof((array)) / sizeof((array)[0]))
@@ -11,6 +13,9 @@
 #define MIN(a, b) ((a) > (b) ? (b) : (a))
 #define MAX(a, b) ((a) > (b) ? (a) : (b))
 
+// An IPv4 or IPv6 address, link-local IPv6 addresses carry a %interface scope
+#define ADDRESS_STRLEN  (INET6_ADDRSTRLEN + IF_NAMESIZE)
+
 // Grid
 //#define DEFAULT_GRID_WIDTH  10
 //#define DEFAULT_GRID_HEIGHT 20
@@ -18,9 +23,9 @@
 #define DEFAULT_GRID_HEIGHT 12
 
 #define MIN_GRID_WIDTH  10
-#define MAX_GRID_WIDTH  20
+#define MAX_GRID_WIDTH  256
 #define MIN_GRID_HEIGHT 10
-#define MAX_GRID_HEIGHT 20
+#define MAX_GRID_HEIGHT 256
 
 // WLED
 #define WLED_WARLS      1
@@ -28,13 +33,92 @@
 #define WLED_DRGBW      3
 #define WLED_DNRGB      4
 
-// 490 is the maximum number of LEDs which can fit into 1472 bytes which is the max size of an unfragmented UDP datagram over IPv4 on 1500 MTU Ethernet
+// 490 is the maximum number of LEDs which can fit into one DRGB packet, 483 over IPv6
 #define WLED_DRGB_MAX_LEDS  490
+#define WLED_DRGB_MAX_LEDS6 483
+
+// DRGBW takes 4 bytes per LED and has no start index, so an RGBW controller gets at most 362 LEDs,
+// the controller may be found on an IPv6 address
+#define WLED_DRGBW_MAX_LEDS 362
 
-#define MAX_GRID_SIZE       MAX(WLED_DRGB_MAX_LEDS, (MAX_GRID_WIDTH * MAX_GRID_HEIGHT))
+// DNRGB has a 16 bit start index, so larger grids are sent as several packets of up to 489 LEDs, 482 over IPv6
+#define WLED_DNRGB_MAX_LEDS 489
+#define WLED_DNRGB_MAX_LEDS6 482
 
 // Display
 #define DISPLAY_TIMEOUT 3
+#define MAX_FPS         200
+
+// Output
+#define OUTPUT_KEEPALIVE    SCHED_NSEC_PER_SEC  /* well within DISPLAY_TIMEOUT */
+#define MAX_OUTPUT_TARGETS  16
+
+// ICMP errors, each within OUTPUT_UNREACHABLE_WINDOW of the previous one, after which the mdns controller is looked up again
+#define OUTPUT_REDISCOVER_ERRORS    3
+#define OUTPUT_UNREACHABLE_WINDOW   (10 * SCHED_NSEC_PER_SEC)  /* a failed ARP lookup takes a few seconds */
+#define OUTPUT_REDISCOVER_INTERVAL  (5 * SCHED_NSEC_PER_SEC)
+
+// Transmit, frames are sent TX_DELAY after their frame deadline, which leaves the main loop time to render them
+#define TX_DELAY            (2 * SCHED_NSEC_PER_SEC / 1000)
+#define TX_TXTIME_LEAD      (SCHED_NSEC_PER_SEC / 1000)     /* SO_TXTIME packets are handed to the kernel this early */
+
+// Rate control, the output frame rate is halved on congestion and ramps back up once the link keeps up
+#define OUTPUT_MIN_FPS          5
+#define OUTPUT_RATE_STEP        10                          /* fps per second */
+#define OUTPUT_BACKOFF_INTERVAL (SCHED_NSEC_PER_SEC / 4)    /* errors of the same burst only back off once */
+#define OUTPUT_RATE_HOLD        SCHED_NSEC_PER_SEC          /* no ramping up this soon after a back-off */
+
+// 1472 bytes is the max size of an unfragmented UDP datagram over IPv4 on 1500 MTU Ethernet,
+// the IPv6 header is 20 bytes larger, backends keep packets to IPv6 addresses within 1452 bytes
+#define OUTPUT_MAX_PACKET_SIZE  1472
+#define OUTPUT_MAX_PACKET_SIZE6 1452
+
+// IPv4 and UDP header, paid for every packet
+#define OUTPUT_UDP_OVERHEAD     28
+
+// Deltas needing more runs than this are sent as one range
+#define OUTPUT_MAX_DELTA_RUNS   16
+
+// Tile orientation, how a tile's panel is mounted relative to the canvas
+#define ORIENT_NORMAL   0
+#define ORIENT_CW       1   /* rotated 90 degrees clockwise */
+#define ORIENT_180      2
+#define ORIENT_CCW      3   /* rotated 90 degrees counter-clockwise */
+#define ORIENT_FLIP_H   4   /* mirrored left to right */
+#define ORIENT_FLIP_V   5   /* mirrored top to bottom */
+
+// LED wiring, the order of the LEDs on a panel
+#define LED_WIRING_ROWS         0   /* row by row, left to right */
+#define LED_WIRING_SERPENTINE   1   /* every other row right to left */
+#define LED_WIRING_FILE         2   /* a table loaded with --led-map */
+
+// Output scaler, how the canvas is scaled to a display of a different size, see scale.c
+#define SCALE_NEAREST   0
+#define SCALE_BLOCK     1   /* whole multiples of the canvas, centered */
+#define SCALE_BOX       2   /* averages the canvas pixels under every display pixel */
+
+// Power limiter, a WS2812 draws about 20 mA per channel at full brightness and 1 mA when dark
+#define POWER_CHANNEL_MA    20
+#define POWER_IDLE_MA       1
+#define POWER_SCALE_ONE     256
+#define POWER_RECOVERY      (2 * SCHED_NSEC_PER_SEC)    /* from fully dark back to full brightness */
+
+// Shared memory frame sink, see shm.c
+#define SHM_MAGIC       0x4d4c4652  /* "MLFR" */
+#define SHM_VERSION     1
+#define SHM_SLOTS       4           /* frames a reader may lag behind before they're overwritten */
+
+// Frame capture, see capture.c
+#define CAPTURE_MAGIC   "MLCAPTUR"  /* not terminated */
+#define CAPTURE_VERSION 1
+
+// Scheduler
+#define SCHED_NSEC_PER_SEC  1000000000ULL
+#define SCHED_NSEC(sec)     ((uint64_t)llround((sec) * (double)SCHED_NSEC_PER_SEC))
+
+// Tick catch-up policy when more than max_catchup ticks are due at once
+#define CATCHUP_DROP    0   /* skip the missed ticks */
+#define CATCHUP_SLOW    1   /* run them later, the game falls behind the clock */
 
 // RGB
 #define COLOR_RGB(r, g, b)    (((r) << 16) | ((g) << 8) | (b))
@@ -62,6 +146,7 @@
 
 #define INPUT_KEYBOARD  0
 #define INPUT_JOYSTICK  1
+#define INPUT_REPLAY    2   /* events come from a capture file */
 
 // Keys
 #define KEYPAD_NONE     0
@@ -88,6 +173,7 @@ struct joystick {
     char name[128];
 
     int player;
+    bool polled;
 
     int key_state;
     int last_key_idx;
@@ -100,20 +186,105 @@ struct game {
     bool playable;
     bool non_interruptable;
     double tick_freq;
+    int max_catchup;
+    int catchup_policy;
     void (*init_func)(void);
     void (*activate_func)(bool start);
     void (*deactivate_func)(void);
     void (*input_func)(int player, int key_idx, bool key_val, int key_state);
     void (*tick_func)();
+    void (*interpolate_func)(double phase);
     void (*render_func)(bool *display, char *screen);
     bool (*idle_func)(void);
 };
 
+typedef void (*event_func)(int fd, unsigned int events, void *arg);
+
+struct sched_timer;
+
+struct output_run {
+    size_t first;
+    size_t last;
+};
+
+struct output_delta {
+    size_t changed;
+    size_t num_runs;
+    bool too_many_runs;
+    struct output_run runs[OUTPUT_MAX_DELTA_RUNS];
+};
+
+/* per target state of a backend */
+struct output_stream {
+    const struct sockaddr_storage *addr;    /* where the target's packets go */
+    uint8_t sequence;                       /* for protocols with sequence numbers */
+    bool rgbw;                              /* the receiver has a white channel */
+    void *state;                            /* allocated by the backend's init_func */
+};
+
+struct output_backend {
+    const char *name;
+    int port;
+    void (*init_func)(struct output_stream *stream, size_t num_leds);
+    void (*free_func)(struct output_stream *stream);
+    size_t (*max_packets_func)(size_t num_leds);
+    void (*encode_func)(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, struct output_stream *stream);
+    void (*print_stats_func)(void);
+};
+
+/* start of the shared memory segment, followed by SHM_SLOTS slots of slot_size bytes */
+struct shm_header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t num_slots;
+    uint32_t slot_size;
+    uint64_t sequence;                      /* last complete frame, it's in slot sequence % num_slots */
+    uint32_t futex;                         /* changes with every frame, FUTEX_WAIT on it */
+    uint32_t reserved;
+};
+
+struct shm_slot {
+    uint64_t sequence;                      /* 0 while the slot is being written */
+    uint64_t timestamp;                     /* CLOCK_MONOTONIC, nanoseconds */
+    unsigned char pixels[];                 /* width * height RGB, row by row */
+};
+
+/* start of a capture file, everything needed to run the same session again */
+struct capture_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    int32_t fps;
+    char game[16];                          /* empty for the default game */
+    uint8_t start_on_startup;
+    uint8_t debug;
+    uint16_t reserved;
+    uint32_t seed;
+    uint64_t start_time;
+    char ip_address[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
+    char wled_address[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
+};
+
+struct output_timing {
+    uint64_t frames;
+    uint64_t packets;
+    uint64_t syscalls;
+    uint64_t scale;
+    uint64_t color;
+    uint64_t power;
+    uint64_t encode;
+    uint64_t send;
+};
+
 extern int grid_width;
 extern int grid_height;
 extern bool grid_widescreen;
 
 extern double time_val;
+extern double tick_phase;
 extern int ticks;
 
 extern const char *wled_ds;
@@ -134,9 +305,105 @@ extern const struct game pong_game;
 extern const struct game breakout_game;
 extern const struct game invaders_game;
 
+extern void event_init(void);
+extern bool event_add(int fd, event_func func, void *arg);
+extern void event_del(int fd);
+extern bool event_add_signal(int signo, event_func func, void *arg);
+extern void event_notify(void);
+extern int event_wait(int timeout);
+
+extern uint64_t sched_now(void);
+extern struct sched_timer *sched_timer_new(uint64_t period);
+extern struct sched_timer *sched_timer_get(uint64_t period);
+extern void sched_timer_start(struct sched_timer *timer, uint64_t now);
+extern void sched_timer_stop(struct sched_timer *timer);
+extern bool sched_timer_running(const struct sched_timer *timer);
+extern bool sched_timer_expired(struct sched_timer *timer, uint64_t now);
+extern bool sched_timer_due(const struct sched_timer *timer, uint64_t now);
+extern uint64_t sched_timer_lag(const struct sched_timer *timer, uint64_t now);
+extern uint64_t sched_timer_skip(struct sched_timer *timer, uint64_t now);
+extern uint64_t sched_timer_delay(struct sched_timer *timer, uint64_t now);
+extern double sched_timer_phase(const struct sched_timer *timer, uint64_t now);
+extern uint64_t sched_timer_last_deadline(const struct sched_timer *timer);
+
+extern const struct output_backend wled_backend;
+extern const struct output_backend ddp_backend;
+extern const struct output_backend e131_backend;
+extern const struct output_backend artnet_backend;
+
+extern void output_set_backend(const struct output_backend *output_backend);
+extern unsigned char *output_new_packet(size_t len);
+extern unsigned char *output_new_packet_to(size_t len, const struct sockaddr_storage *addr);
+extern void output_add_packet(const void *buf, size_t len, const struct sockaddr_storage *addr);
+extern void output_find_delta(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, size_t gap, size_t max_run, struct output_delta *delta);
+extern bool output_add_tile(int x, int y, int width, int height, const struct sockaddr_storage *addr, int orientation, bool rgbw);
+extern void output_set_orientation(int orientation);
+extern void output_set_rgbw(bool enabled);
+extern void output_set_scale(int width, int height, int filter);
+extern bool output_set_led_map(const char *spec);
+extern bool output_add_mirror(const struct sockaddr_storage *addr, int max_fps);
+extern void output_enable_mirrors(bool enabled);
+extern void output_init(void);
+extern void output_reset(void);
+extern void output_frame(const struct sockaddr_storage *addr, const char *frame, uint64_t now);
+extern void output_frame_at(const struct sockaddr_storage *addr, const char *frame, uint64_t now, uint64_t txtime);
+extern uint64_t output_pending(void);
+extern void output_send_pending(uint64_t now);
+extern bool output_enable_txtime(void);
+extern void output_get_timing(struct output_timing *timing);
+extern void output_print_stats(void);
+
+extern void tx_init(bool use_txtime);
+extern void tx_frame(const struct sockaddr_storage *addr, const char *pixels, uint64_t deadline);
+extern void tx_reset(void);
+extern void tx_enable_mirrors(bool enabled);
+extern void tx_print_stats(void);
+
+extern void benchmark(void);
+
+extern const char *scale_name(int scale_filter);
+extern int scale_find(const char *name);
+extern bool scale_init(int width, int height, int scale_filter);
+extern void scale_frame(const unsigned char *src, unsigned char *dst);
+
+extern void color_init(double gamma, int red, int green, int blue);
+extern void color_enable_dither(bool enabled);
+extern void color_set_brightness(int percent);
+extern int color_get_brightness(void);
+extern bool color_frame(const unsigned char *src, unsigned char *dst, size_t num_leds);
+
+extern void rgbw_init(int percent, double exponent);
+extern void rgbw_convert(const unsigned char *rgb, unsigned char *rgbw, size_t num_leds);
+
+extern void power_init(unsigned int budget, unsigned int channel, unsigned int idle);
+extern bool power_frame(const unsigned char *src, unsigned char *dst, size_t num_leds, uint64_t now);
+extern void power_print_stats(void);
+
+extern void shm_init(const char *name);
+extern void shm_frame(const char *frame, uint64_t now);
+
+extern void capture_init(const char *path, const struct capture_header *header);
+extern void capture_step(uint64_t now);
+extern void capture_input(const struct joystick *joystick);
+extern void capture_joysticks(const int *players, size_t num_players);
+extern void capture_announce(const char *text, unsigned int color, unsigned int bgcolor, double speed);
+extern void capture_wled_ip(const char *address);
+extern void capture_frame(const char *frame);
+extern void verify_init(const char *path, struct capture_header *header);
+extern bool verify_step(uint64_t *now);
+extern bool verify_input(int *player, int *key_idx, bool *key_val, int *key_state);
+extern bool verify_joysticks(int *players, size_t *num_players);
+extern bool verify_announce(char **text, unsigned int *color, unsigned int *bgcolor, double *speed);
+extern bool verify_wled_ip(char *address, size_t size);
+extern void verify_frame(const char *frame);
+extern bool verify_finish(void);
+
 extern char ip_address[MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN)];
 extern void ip_init(void);
+extern bool ip_parse_address(const char *str, uint16_t port, struct sockaddr_storage *addr);
+extern bool ip_format_address(const struct sockaddr_storage *addr, char *buf, size_t len);
 extern void mdns_init(void);
+extern void mdns_rediscover(void);
 extern void input_reset(void);
 extern void init_joystick(const char *devnode);
 extern void init_udev_hotplug(void);
@@ -145,6 +412,10 @@ extern bool read_joystick(struct joystick **joystick_ptr);
 extern int count_joysticks(void);
 extern bool joystick_is_key_seq(struct joystick *joystick, const int *seq, size_t seq_length);
 extern bool has_player(int player);
+extern size_t get_players(int *players, size_t max_players);
+extern void replay_joysticks(const int *players, size_t num_players);
+extern struct joystick *replay_joystick(int player, int key_idx, bool key_val, int key_state);
+extern int input_timeout(void);
 extern void mqtt_init(void);
 extern bool wled_api_check(const char *addr);
 
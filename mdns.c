@@ -4,8 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <time.h>
 #include <assert.h>
 #include <pthread.h>
+#include <netinet/in.h>
 
 #include <avahi-client/client.h>
 #include <avahi-client/lookup.h>
@@ -15,8 +17,10 @@
 
 #include "matelight.h"
 
+#define MDNS_INTERVAL   60  /* secs between lookups while the controller is fine */
+
 struct wled_server {
-    char address[AVAHI_ADDRESS_STR_MAX];
+    char address[ADDRESS_STRLEN];
     bool is_wled;
 };
 
@@ -29,12 +33,15 @@ static size_t n_resolvers = 0;
 static struct wled_server *wled_servers = NULL;
 static size_t num_wled_servers = 0;
 
+static pthread_mutex_t rediscover_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t rediscover_cond;
+static bool rediscover = false;
+
 static void resolve_callback(AvahiServiceResolver *r, AvahiIfIndex interface, AvahiProtocol protocol, AvahiResolverEvent event, const char *name, const char *type, const char *domain, const char *host_name, const AvahiAddress *address, uint16_t port, AvahiStringList *txt, AvahiLookupResultFlags flags, void* userdata) {
-    char a[AVAHI_ADDRESS_STR_MAX];
+    char a[ADDRESS_STRLEN];
     char *t;
     struct wled_server *new_wled_servers;
 
-    (void)interface;
     (void)protocol;
     (void)userdata;
 
@@ -48,6 +55,9 @@ static void resolve_callback(AvahiServiceResolver *r, AvahiIfIndex interface, Av
         case AVAHI_RESOLVER_FOUND: {
             fprintf(stderr, "mdns: Service '%s' of type '%s' in domain '%s':\n", name, type, domain);
             avahi_address_snprint(a, sizeof(a), address);
+            /* a link-local address is only reachable through the interface it was found on */
+            if (address->proto == AVAHI_PROTO_INET6 && IN6_IS_ADDR_LINKLOCAL((const struct in6_addr *)address->data.ipv6.address))
+                snprintf(a + strlen(a), sizeof(a) - strlen(a), "%%%d", interface);
             t = avahi_string_list_to_string(txt);
             if (t) {
                 fprintf(stderr,
@@ -132,6 +142,7 @@ static void *mdns_thread_func(void *arg)
 {
     int error;
     size_t i;
+    struct timespec timeout;
 
     (void)arg;
 
@@ -189,7 +200,16 @@ static void *mdns_thread_func(void *arg)
         wled_servers = NULL;
         num_wled_servers = 0;
 
-        sleep(60);
+        /* the output wakes us up early when the controller stops answering */
+        (void)clock_gettime(CLOCK_MONOTONIC, &timeout);
+        timeout.tv_sec += MDNS_INTERVAL;
+        (void)pthread_mutex_lock(&rediscover_mutex);
+        while (! rediscover) {
+            if (pthread_cond_timedwait(&rediscover_cond, &rediscover_mutex, &timeout) != 0)
+                break;
+        }
+        rediscover = false;
+        (void)pthread_mutex_unlock(&rediscover_mutex);
     }
 
     fprintf(stderr, "mdns: Done.\n");
@@ -197,8 +217,23 @@ static void *mdns_thread_func(void *arg)
     return NULL;
 }
 
+void mdns_rediscover(void)
+{
+    (void)pthread_mutex_lock(&rediscover_mutex);
+    rediscover = true;
+    (void)pthread_cond_signal(&rediscover_cond);
+    (void)pthread_mutex_unlock(&rediscover_mutex);
+}
+
 void mdns_init(void)
 {
+    pthread_condattr_t attr;
+
+    (void)pthread_condattr_init(&attr);
+    (void)pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    (void)pthread_cond_init(&rediscover_cond, &attr);
+    (void)pthread_condattr_destroy(&attr);
+
     if (pthread_create(&mdns_thread, NULL, mdns_thread_func, NULL) != 0) {
         perror("pthread_create");
         return;
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <ctype.h>
 #include <pthread.h>
 
 #include <mosquitto.h>
@@ -10,6 +11,7 @@
 #include "matelight.h"
 
 #define MQTT_TOPIC "hackeriet/ding"
+#define MQTT_BRIGHTNESS_TOPIC "hackeriet/matelight/brightness"
 #define CA_CERTIFICATES "/etc/ssl/certs/ca-certificates.crt"
 
 static const char *mqtt_server = "localhost";
@@ -42,6 +44,8 @@ static void on_connect(struct mosquitto *mosq, void *obj, int reason_code)
     }
 
     rc = mosquitto_subscribe(mosq, NULL, MQTT_TOPIC, 1);
+    if (rc == MOSQ_ERR_SUCCESS)
+        rc = mosquitto_subscribe(mosq, NULL, MQTT_BRIGHTNESS_TOPIC, 1);
     if (rc != MOSQ_ERR_SUCCESS) {
         fprintf(stderr, "mqtt: Error subscribing: %s\n", mosquitto_strerror(rc));
         mosquitto_disconnect(mosq);
@@ -102,6 +106,9 @@ static void strip_garbage(char *text)
 static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *msg)
 {
     char *text;
+    char *end;
+    char brightness[8];
+    long percent;
     (void)mosq;
     (void)obj;
 
@@ -116,6 +123,20 @@ static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto
             do_announce_async(text, COLOR_BLACK, COLOR_YELLOW, 5.0);
         }
     }
+
+    /* percent, the next frame is sent with it, anything else mustn't black out the display */
+    if (msg->topic && strcmp(msg->topic, MQTT_BRIGHTNESS_TOPIC) == 0 && msg->payloadlen > 0 && msg->payloadlen < 8) {
+        memcpy(brightness, msg->payload, msg->payloadlen);
+        brightness[msg->payloadlen] = '\0';
+        percent = strtol(brightness, &end, 10);
+        while (isspace((unsigned char)*end))
+            end++;
+        if (end == brightness || *end != '\0') {
+            fprintf(stderr, "mqtt: invalid brightness: %s\n", brightness);
+            return;
+        }
+        color_set_brightness(percent);
+    }
 }
 
 static void *mqtt_thread_func(void *arg)
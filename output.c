@@ -0,0 +1,1192 @@
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#include <linux/sockios.h>
+
+#include "matelight.h"
+
+/* packets and failed sendmmsg() calls per address family */
+struct family_stats {
+    uint64_t packets;
+    uint64_t errors;
+    int last_error;
+};
+
+struct output_stats {
+    uint64_t sent;
+    uint64_t suppressed;
+    uint64_t keepalives;
+    uint64_t errors;
+    uint64_t unreachable;
+    uint64_t rediscoveries;
+    uint64_t backoffs;
+    uint64_t throttled;             /* frames skipped by the rate control */
+    uint64_t congested;             /* sends failed with EAGAIN or ENOBUFS */
+    uint64_t queue_full;            /* frames that found the last one still queued */
+    uint64_t bytes;
+    struct family_stats ipv4;
+    struct family_stats ipv6;
+    struct output_timing timing;
+};
+
+struct target_stats {
+    uint64_t sent;
+    uint64_t suppressed;
+    uint64_t limited;
+    uint64_t errors;
+    uint64_t unreachable;           /* ICMP port or host unreachable */
+    uint64_t bytes;
+};
+
+/* a display controller showing a rectangle of the canvas, or all of it */
+struct output_target {
+    struct sockaddr_storage addr;   /* AF_UNSPEC uses the --address or mdns controller */
+    bool whole_canvas;
+    int x;
+    int y;
+    int width;
+    int height;
+    int orientation;
+    bool rgbw;
+    bool mirror;
+    bool enabled;
+    uint64_t min_interval;          /* rate limit, 0 sends every frame */
+    size_t num_leds;
+    uint32_t *map;                  /* frame offset of every LED, NULL if the target is the whole canvas */
+    unsigned char *pixels;          /* the target's LEDs of the current frame */
+    unsigned char *last_frame;      /* the LEDs the receiver has been sent successfully, deltas are encoded against it */
+    bool last_frame_valid;
+    uint64_t last_send;
+    bool keepalive;
+    struct output_stream stream;
+    unsigned int unreachable;       /* ICMP errors in a row */
+    uint64_t last_unreachable;
+    size_t first_packet;
+    size_t num_packets;
+    struct target_stats stats;
+};
+
+/* IPv6 gets its own socket, so IPv4 keeps working on hosts without it */
+static int udp_fd = -1;
+static int udp6_fd = -1;
+static const struct output_backend *backend = &wled_backend;
+
+static struct output_target targets[MAX_OUTPUT_TARGETS];
+static size_t num_targets = 0;
+static bool tiled = false;
+static int mount_orientation = ORIENT_NORMAL;  /* of the controller showing the whole canvas without tiles */
+static bool default_rgbw = false;
+
+/* the display the canvas is scaled to, tiles are placed on it */
+static bool scaling = false;
+static int scale_filter = SCALE_NEAREST;
+static int display_width = 0;
+static int display_height = 0;
+static unsigned char *scaled = NULL;
+static unsigned char *colored = NULL;
+static bool default_target = false;
+
+static size_t max_packets = 0;
+static size_t num_packets = 0;
+static unsigned char *packets = NULL;
+static struct iovec *iovs = NULL;
+static struct mmsghdr *msgs = NULL;
+
+/* physical wiring, the panel pixel every LED shows, the same for every target */
+static int led_wiring = LED_WIRING_ROWS;
+static uint32_t *led_map = NULL;
+static size_t led_map_len = 0;
+
+/* SCM_TXTIME of every packet, the qdisc holds them until then */
+static bool txtime_enabled = false;
+static char (*txtimes)[CMSG_SPACE(sizeof(uint64_t))] = NULL;
+
+/* AIMD frame rate control for a congested link, shared by all targets */
+struct rate_control {
+    double fps;                     /* 0 doesn't limit the frames */
+    double source_interval;         /* average time between frames coming in */
+    uint64_t last_frame;
+    uint64_t last_sent;
+    uint64_t last_backoff;
+    uint64_t last_update;
+    size_t last_bytes;              /* bytes of the last frame sent */
+    bool congested;
+};
+
+static struct output_stats stats = { 0 };
+static struct rate_control rate = { 0 };
+
+/* the latest throttled frame, it's sent once the rate allows unless a newer one comes first */
+static char *pending = NULL;
+static struct sockaddr_storage pending_addr;
+static bool pending_valid = false;
+static uint64_t last_rediscover = 0;
+
+static struct output_target *new_target(const struct sockaddr_storage *addr)
+{
+    struct output_target *target = NULL;
+
+    if (num_targets >= MAX_OUTPUT_TARGETS) {
+        fprintf(stderr, "output: too many targets\n");
+        return NULL;
+    }
+
+    target = &targets[num_targets++];
+    memset(target, '\0', sizeof(*target));
+    memcpy(&target->addr, addr, sizeof(target->addr));
+    target->orientation = ORIENT_NORMAL;
+    target->enabled = true;
+
+    return target;
+}
+
+bool output_add_tile(int x, int y, int width, int height, const struct sockaddr_storage *addr, int orientation, bool rgbw)
+{
+    struct output_target *target = new_target(addr);
+
+    if (! target)
+        return false;
+
+    target->x = x;
+    target->y = y;
+    target->width = width;
+    target->height = height;
+    target->orientation = orientation;
+    target->rgbw = rgbw;
+    tiled = true;
+
+    return true;
+}
+
+bool output_add_mirror(const struct sockaddr_storage *addr, int max_fps)
+{
+    struct output_target *target = new_target(addr);
+
+    if (! target)
+        return false;
+
+    target->whole_canvas = true;
+    target->mirror = true;
+    if (max_fps > 0)
+        target->min_interval = SCHED_NSEC_PER_SEC / max_fps;
+
+    return true;
+}
+
+void output_set_orientation(int orientation)
+{
+    mount_orientation = orientation;
+}
+
+void output_set_rgbw(bool enabled)
+{
+    default_rgbw = enabled;
+}
+
+void output_set_scale(int width, int height, int filter)
+{
+    scaling = width > 0 && height > 0;
+    display_width = width;
+    display_height = height;
+    scale_filter = filter;
+}
+
+void output_enable_mirrors(bool enabled)
+{
+    size_t i;
+
+    for (i = 0; i < num_targets; i++) {
+        if (! targets[i].mirror || targets[i].enabled == enabled)
+            continue;
+
+        /* a mirror that has been off doesn't show the last frame anymore */
+        targets[i].enabled = enabled;
+        targets[i].last_frame_valid = false;
+    }
+}
+
+static bool add_led(size_t *len, size_t *size, unsigned long idx)
+{
+    uint32_t *map = NULL;
+
+    if (*len >= *size) {
+        *size = *size ? *size * 2 : 256;
+        map = realloc(led_map, *size * sizeof(*led_map));
+        if (! map)
+            return false;
+        led_map = map;
+    }
+
+    led_map[(*len)++] = idx;
+    return true;
+}
+
+bool output_set_led_map(const char *spec)
+{
+    char *line = NULL;
+    size_t line_size = 0;
+    char *field = NULL;
+    char *spec_line = NULL;
+    char *end = NULL;
+    unsigned long idx;
+    size_t size = 0;
+    size_t len = 0;
+    FILE *file = NULL;
+
+    if (strcmp(spec, "rows") == 0) {
+        led_wiring = LED_WIRING_ROWS;
+        return true;
+    }
+    if (strcmp(spec, "serpentine") == 0) {
+        led_wiring = LED_WIRING_SERPENTINE;
+        return true;
+    }
+
+    file = fopen(spec, "r");
+    if (! file) {
+        perror(spec);
+        return false;
+    }
+
+    /* the panel pixel of every LED in wiring order, row-major, separated by whitespace or commas, # starts a comment */
+    while (getline(&line, &line_size, file) != -1) {
+        spec_line = line;
+        end = strchr(line, '#');
+        if (end)
+            *end = '\0';
+
+        while ((field = strsep(&spec_line, " \t\r\n,")) != NULL) {
+            if (! *field)
+                continue;
+
+            errno = 0;
+            idx = strtoul(field, &end, 10);
+            if (*end || errno || idx >= MAX_GRID_WIDTH * MAX_GRID_HEIGHT) {
+                fprintf(stderr, "%s: invalid LED \"%s\"\n", spec, field);
+                free(line);
+                fclose(file);
+                return false;
+            }
+            if (! add_led(&len, &size, idx)) {
+                perror("output_set_led_map");
+                free(line);
+                fclose(file);
+                return false;
+            }
+        }
+    }
+    free(line);
+    fclose(file);
+
+    if (! len) {
+        fprintf(stderr, "%s: no LEDs\n", spec);
+        return false;
+    }
+
+    led_map_len = len;
+    led_wiring = LED_WIRING_FILE;
+    return true;
+}
+
+static size_t panel_pixel(size_t led, int panel_width)
+{
+    size_t row = led / panel_width;
+    size_t col = led % panel_width;
+
+    switch (led_wiring) {
+        case LED_WIRING_SERPENTINE:
+            /* every other row runs back */
+            if (row & 1)
+                col = panel_width - 1 - col;
+            return (row * panel_width) + col;
+        case LED_WIRING_FILE:
+            return led_map[led];
+        case LED_WIRING_ROWS:
+        default:
+            return led;
+    }
+}
+
+static void map_target(struct output_target *target)
+{
+    int panel_width = target->width;
+    int cx, cy, px, py;
+    size_t i, pixel;
+
+    if (target->orientation == ORIENT_CW || target->orientation == ORIENT_CCW)
+        panel_width = target->height;
+
+    /* find the panel pixel of each LED, and the canvas pixel under it, so sending is a single gather */
+    for (i = 0; i < target->num_leds; i++) {
+        pixel = panel_pixel(i, panel_width);
+        px = pixel % panel_width;
+        py = pixel / panel_width;
+        switch (target->orientation) {
+            case ORIENT_CW:
+                cx = target->width - 1 - py;
+                cy = px;
+                break;
+            case ORIENT_180:
+                cx = target->width - 1 - px;
+                cy = target->height - 1 - py;
+                break;
+            case ORIENT_CCW:
+                cx = py;
+                cy = target->height - 1 - px;
+                break;
+            case ORIENT_FLIP_H:
+                cx = target->width - 1 - px;
+                cy = py;
+                break;
+            case ORIENT_FLIP_V:
+                cx = px;
+                cy = target->height - 1 - py;
+                break;
+            case ORIENT_NORMAL:
+            default:
+                cx = px;
+                cy = py;
+                break;
+        }
+        target->map[i] = (((target->y + cy) * display_width) + (target->x + cx)) * 3;
+    }
+}
+
+static void free_target(struct output_target *target)
+{
+    if (backend->free_func)
+        backend->free_func(&target->stream);
+
+    /* without a map the pixels point into the frame */
+    if (target->map)
+        free(target->pixels);
+    free(target->map);
+    free(target->last_frame);
+    target->map = NULL;
+    target->pixels = NULL;
+    target->last_frame = NULL;
+}
+
+static void init_target(struct output_target *target)
+{
+    size_t i;
+
+    if (target->whole_canvas) {
+        target->x = 0;
+        target->y = 0;
+        target->width = display_width;
+        target->height = display_height;
+    }
+
+    if (target->x < 0 || target->y < 0 || target->width < 1 || target->height < 1 ||
+        target->x + target->width > display_width || target->y + target->height > display_height) {
+        fprintf(stderr, "output: tile %dx%d at %d,%d is outside the %dx%d grid\n",
+                target->width, target->height, target->x, target->y, display_width, display_height);
+        exit(EXIT_FAILURE);
+    }
+
+    target->num_leds = target->width * target->height;
+    if (led_wiring == LED_WIRING_FILE && led_map_len != target->num_leds) {
+        fprintf(stderr, "output: the LED map has %zu LEDs, the %dx%d tile at %d,%d has %zu\n",
+                led_map_len, target->width, target->height, target->x, target->y, target->num_leds);
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < led_map_len; i++) {
+        if (led_map[i] >= target->num_leds) {
+            fprintf(stderr, "output: LED %zu of the LED map is outside the %dx%d tile\n", i, target->width, target->height);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    target->last_frame = calloc(target->num_leds, 3);
+    if (! target->last_frame) {
+        perror("output_init");
+        exit(EXIT_FAILURE);
+    }
+
+    /* the whole canvas in its own orientation and wired row by row is sent straight from the frame */
+    if (target->num_leds != (size_t)(display_width * display_height) || target->orientation != ORIENT_NORMAL || led_wiring != LED_WIRING_ROWS) {
+        target->map = malloc(target->num_leds * sizeof(*target->map));
+        target->pixels = malloc(target->num_leds * 3);
+        if (! target->map || ! target->pixels) {
+            perror("output_init");
+            exit(EXIT_FAILURE);
+        }
+        map_target(target);
+    }
+
+    /* DRGBW is a single packet without a start index */
+    if (target->rgbw && (backend != &wled_backend || target->num_leds > WLED_DRGBW_MAX_LEDS)) {
+        fprintf(stderr, "output: RGBW needs the wled protocol and at most %d LEDs per controller, the %dx%d tile at %d,%d has %zu\n",
+                WLED_DRGBW_MAX_LEDS, target->width, target->height, target->x, target->y, target->num_leds);
+        exit(EXIT_FAILURE);
+    }
+    target->stream.rgbw = target->rgbw;
+
+    if (backend->init_func)
+        backend->init_func(&target->stream, target->num_leds);
+
+    target->last_frame_valid = false;
+    target->last_send = 0;
+}
+
+static void init_socket6(void)
+{
+    int on = 1;
+
+    udp6_fd = socket(AF_INET6, SOCK_DGRAM, 0);
+    if (udp6_fd == -1) {
+        /* IPv6 targets count as send errors */
+        perror("output: ipv6");
+        return;
+    }
+
+    /* IPv4 is sent from udp_fd, so this one doesn't need mapped addresses */
+    if (setsockopt(udp6_fd, IPPROTO_IPV6, IPV6_V6ONLY, &on, sizeof(on)) == -1 ||
+        setsockopt(udp6_fd, IPPROTO_IPV6, IPV6_RECVERR, &on, sizeof(on)) == -1) {
+        perror("setsockopt");
+        exit(EXIT_FAILURE);
+    }
+}
+
+void output_init(void)
+{
+    size_t i;
+    int on = 1;
+
+    if (udp_fd == -1) {
+        udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (udp_fd == -1) {
+            perror("socket");
+            exit(EXIT_FAILURE);
+        }
+
+        /* Art-Net nodes are commonly addressed by the subnet broadcast */
+        if (setsockopt(udp_fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on)) == -1) {
+            perror("setsockopt");
+            exit(EXIT_FAILURE);
+        }
+
+        /* the socket isn't connected, so ICMP errors are only reported through the error queue */
+        if (setsockopt(udp_fd, SOL_IP, IP_RECVERR, &on, sizeof(on)) == -1) {
+            perror("setsockopt");
+            exit(EXIT_FAILURE);
+        }
+
+        init_socket6();
+    }
+
+    free(packets);
+    free(iovs);
+    free(msgs);
+    free(txtimes);
+    free(scaled);
+    free(colored);
+    scaled = NULL;
+    if (! scaling) {
+        display_width = grid_width;
+        display_height = grid_height;
+    } else {
+        if (! scale_init(display_width, display_height, scale_filter))
+            exit(EXIT_FAILURE);
+        scaled = malloc(display_width * display_height * 3);
+        if (! scaled) {
+            perror("output_init");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    colored = malloc(display_width * display_height * 3);
+    free(pending);
+    pending = malloc(grid_width * grid_height * 3);
+    pending_valid = false;
+    if (! colored || ! pending) {
+        perror("output_init");
+        exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < num_targets; i++) {
+        free_target(&targets[i]);
+    }
+
+    /* without tiles a single controller shows the whole canvas, ahead of any mirrors */
+    if (! tiled && ! default_target) {
+        if (num_targets >= MAX_OUTPUT_TARGETS) {
+            fprintf(stderr, "output: too many targets\n");
+            exit(EXIT_FAILURE);
+        }
+        memmove(&targets[1], &targets[0], num_targets * sizeof(targets[0]));
+        memset(&targets[0], '\0', sizeof(targets[0]));
+        targets[0].addr.ss_family = AF_UNSPEC;
+        targets[0].whole_canvas = true;
+        targets[0].orientation = mount_orientation;
+        targets[0].rgbw = default_rgbw;
+        targets[0].enabled = true;
+        num_targets++;
+        default_target = true;
+    }
+
+    max_packets = 0;
+    for (i = 0; i < num_targets; i++) {
+        init_target(&targets[i]);
+        max_packets += backend->max_packets_func(targets[i].num_leds);
+    }
+
+    packets = malloc(max_packets * OUTPUT_MAX_PACKET_SIZE);
+    iovs = calloc(max_packets, sizeof(*iovs));
+    msgs = calloc(max_packets, sizeof(*msgs));
+    txtimes = calloc(max_packets, sizeof(*txtimes));
+    if (! packets || ! iovs || ! msgs || ! txtimes) {
+        perror("output_init");
+        exit(EXIT_FAILURE);
+    }
+
+    for (i = 0; i < max_packets; i++) {
+        iovs[i].iov_base = packets + (i * OUTPUT_MAX_PACKET_SIZE);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+}
+
+bool output_enable_txtime(void)
+{
+    struct sock_txtime txtime = { CLOCK_MONOTONIC, 0 };
+
+    /* fq holds the packets until their time, other qdiscs send them right away, and etf
+     * only takes CLOCK_TAI sockets, it would drop every one of these */
+    if (setsockopt(udp_fd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == -1 ||
+        (udp6_fd != -1 && setsockopt(udp6_fd, SOL_SOCKET, SO_TXTIME, &txtime, sizeof(txtime)) == -1)) {
+        perror("output: txtime");
+        return false;
+    }
+
+    txtime_enabled = true;
+    return true;
+}
+
+static void set_txtime(size_t idx, uint64_t txtime)
+{
+    struct cmsghdr *cmsg = (struct cmsghdr *)txtimes[idx];
+
+    if (! txtime_enabled || ! txtime) {
+        msgs[idx].msg_hdr.msg_control = NULL;
+        msgs[idx].msg_hdr.msg_controllen = 0;
+        return;
+    }
+
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_TXTIME;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(txtime));
+    memcpy(CMSG_DATA(cmsg), &txtime, sizeof(txtime));
+    msgs[idx].msg_hdr.msg_control = cmsg;
+    msgs[idx].msg_hdr.msg_controllen = sizeof(txtimes[idx]);
+}
+
+void output_reset(void)
+{
+    size_t i;
+
+    /* the next frame is sent in full even if it didn't change */
+    for (i = 0; i < num_targets; i++) {
+        targets[i].last_frame_valid = false;
+        targets[i].last_send = 0;
+        targets[i].unreachable = 0;
+    }
+}
+
+void output_set_backend(const struct output_backend *output_backend)
+{
+    backend = output_backend;
+}
+
+unsigned char *output_new_packet_to(size_t len, const struct sockaddr_storage *addr)
+{
+    msgs[num_packets].msg_hdr.msg_name = (void *)addr;
+    iovs[num_packets].iov_base = packets + (num_packets * OUTPUT_MAX_PACKET_SIZE);
+    iovs[num_packets].iov_len = len;
+    return iovs[num_packets++].iov_base;
+}
+
+unsigned char *output_new_packet(size_t len)
+{
+    return output_new_packet_to(len, NULL);
+}
+
+void output_add_packet(const void *buf, size_t len, const struct sockaddr_storage *addr)
+{
+    /* sent without a copy, the buffer must stay valid until the batch is sent */
+    msgs[num_packets].msg_hdr.msg_name = (void *)addr;
+    iovs[num_packets].iov_base = (void *)buf;
+    iovs[num_packets].iov_len = len;
+    num_packets++;
+}
+
+void output_find_delta(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, size_t gap, size_t max_run, struct output_delta *delta)
+{
+    struct output_run *run = NULL;
+    size_t i;
+
+    delta->changed = 0;
+    delta->num_runs = 0;
+    delta->too_many_runs = false;
+
+    for (i = 0; i < num_leds; i++) {
+        if (memcmp(pixels + (i * 3), last_frame + (i * 3), 3) == 0)
+            continue;
+
+        delta->changed++;
+        if (run && (i - run->last) <= gap && (i - run->first) < max_run) {
+            run->last = i;
+        } else if (delta->num_runs < OUTPUT_MAX_DELTA_RUNS) {
+            run = &delta->runs[delta->num_runs++];
+            run->first = i;
+            run->last = i;
+        } else {
+            /* the last run covers the rest, it may be longer than max_run */
+            delta->too_many_runs = true;
+            run->last = i;
+        }
+    }
+}
+
+static void slice_target(struct output_target *target, const unsigned char *frame)
+{
+    size_t i;
+
+    if (! target->map) {
+        target->pixels = (unsigned char *)frame;
+        return;
+    }
+
+    for (i = 0; i < target->num_leds; i++) {
+        memcpy(target->pixels + (i * 3), frame + target->map[i], 3);
+    }
+}
+
+static bool same_destination(const struct sockaddr_storage *a, const struct sockaddr_storage *b)
+{
+    const struct sockaddr_in *a4 = (const struct sockaddr_in *)a;
+    const struct sockaddr_in *b4 = (const struct sockaddr_in *)b;
+    const struct sockaddr_in6 *a6 = (const struct sockaddr_in6 *)a;
+    const struct sockaddr_in6 *b6 = (const struct sockaddr_in6 *)b;
+
+    if (a->ss_family != b->ss_family)
+        return false;
+
+    switch (a->ss_family) {
+        case AF_INET:
+            return a4->sin_port == b4->sin_port && a4->sin_addr.s_addr == b4->sin_addr.s_addr;
+        case AF_INET6:
+            /* the scope isn't compared, the kernel doesn't always report it */
+            return a6->sin6_port == b6->sin6_port && IN6_ARE_ADDR_EQUAL(&a6->sin6_addr, &b6->sin6_addr);
+        default:
+            return false;
+    }
+}
+
+static void target_unreachable(struct output_target *target, int err, uint64_t now)
+{
+    /* a controller that's gone keeps erroring, at least once per keepalive and failed ARP lookup */
+    if (target->unreachable && now - target->last_unreachable > OUTPUT_UNREACHABLE_WINDOW)
+        target->unreachable = 0;
+
+    target->unreachable++;
+    target->last_unreachable = now;
+    target->stats.unreachable++;
+    stats.unreachable++;
+
+    /* whatever comes back up has lost the last frame */
+    target->last_frame_valid = false;
+
+    /* only the default controller comes from mdns, tiles and mirrors have fixed addresses */
+    if (wled_ds && target->addr.ss_family == AF_UNSPEC && target->unreachable >= OUTPUT_REDISCOVER_ERRORS &&
+        (! last_rediscover || now - last_rediscover >= OUTPUT_REDISCOVER_INTERVAL)) {
+        fprintf(stderr, "output: controller unreachable (%s), looking it up again\n", strerror(err));
+        last_rediscover = now;
+        stats.rediscoveries++;
+        mdns_rediscover();
+    }
+}
+
+static void handle_errors(int fd, uint64_t now)
+{
+    struct sockaddr_storage addr;
+    char control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr msg;
+    struct cmsghdr *cmsg;
+    const struct sock_extended_err *ee;
+    size_t i;
+
+    if (fd == -1)
+        return;
+
+    /* reading the error queue also clears the socket error, so it doesn't fail the next batch */
+    for (;;) {
+        memset(&msg, '\0', sizeof(msg));
+        memset(&addr, '\0', sizeof(addr));
+        msg.msg_name = &addr;
+        msg.msg_namelen = sizeof(addr);
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1)
+            break;
+
+        for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+            if ((cmsg->cmsg_level != SOL_IP || cmsg->cmsg_type != IP_RECVERR) &&
+                (cmsg->cmsg_level != SOL_IPV6 || cmsg->cmsg_type != IPV6_RECVERR))
+                continue;
+
+            ee = (const struct sock_extended_err *)CMSG_DATA(cmsg);
+            if ((ee->ee_origin != SO_EE_ORIGIN_ICMP && ee->ee_origin != SO_EE_ORIGIN_ICMP6) ||
+                (ee->ee_errno != ECONNREFUSED && ee->ee_errno != EHOSTUNREACH))
+                continue;
+
+            /* the queued error carries the address the packet was sent to */
+            for (i = 0; i < num_targets; i++) {
+                if (targets[i].stream.addr && same_destination(targets[i].stream.addr, &addr))
+                    target_unreachable(&targets[i], ee->ee_errno, now);
+            }
+        }
+    }
+}
+
+static double source_fps(void)
+{
+    return rate.source_interval > 0.0 ? (double)SCHED_NSEC_PER_SEC / rate.source_interval : (double)MAX_FPS;
+}
+
+static void rate_backoff(const char *reason, uint64_t now)
+{
+    if (rate.last_backoff && now - rate.last_backoff < OUTPUT_BACKOFF_INTERVAL)
+        return;
+
+    rate.fps = MAX((rate.fps > 0.0 ? rate.fps : source_fps()) / 2.0, (double)OUTPUT_MIN_FPS);
+    rate.last_backoff = now;
+    rate.last_update = now;
+    stats.backoffs++;
+    fprintf(stderr, "output: %s, backing off to %.1f fps\n", reason, rate.fps);
+}
+
+static void rate_source(uint64_t now)
+{
+    uint64_t interval;
+
+    /* the pause between games isn't the frame rate */
+    if (rate.last_frame && now - rate.last_frame < SCHED_NSEC_PER_SEC) {
+        interval = now - rate.last_frame;
+        if (rate.source_interval > 0.0)
+            rate.source_interval += ((double)interval - rate.source_interval) / 16.0;
+        else
+            rate.source_interval = (double)interval;
+    }
+    rate.last_frame = now;
+}
+
+/* half a frame of slack, so a frame that's a little early isn't held back until the next one */
+static uint64_t rate_next_send(void)
+{
+    if (rate.fps <= 0.0 || ! rate.last_sent)
+        return 0;
+
+    return rate.last_sent + (uint64_t)(((double)SCHED_NSEC_PER_SEC / rate.fps) - (rate.source_interval / 2.0));
+}
+
+static bool rate_throttled(uint64_t now)
+{
+    uint64_t ramp_start;
+
+    if (rate.fps <= 0.0)
+        return false;
+
+    /* additive increase once the link has kept up for a while */
+    ramp_start = MAX(rate.last_update, rate.last_backoff + OUTPUT_RATE_HOLD);
+    if (now > ramp_start)
+        rate.fps += OUTPUT_RATE_STEP * ((double)(now - ramp_start) / (double)SCHED_NSEC_PER_SEC);
+    rate.last_update = now;
+
+    if (rate.fps >= source_fps()) {
+        rate.fps = 0.0;
+        fprintf(stderr, "output: link recovered, back to full rate\n");
+        return false;
+    }
+
+    if (now < rate_next_send()) {
+        stats.throttled++;
+        return true;
+    }
+
+    rate.last_sent = now;
+    return false;
+}
+
+static size_t queued_bytes(void)
+{
+    int queued;
+    size_t total = 0;
+
+    /* bytes the qdisc and driver haven't sent yet */
+    if (ioctl(udp_fd, SIOCOUTQ, &queued) == 0)
+        total += queued;
+    if (udp6_fd != -1 && ioctl(udp6_fd, SIOCOUTQ, &queued) == 0)
+        total += queued;
+
+    return total;
+}
+
+static int packet_family(size_t idx)
+{
+    return ((const struct sockaddr *)msgs[idx].msg_hdr.msg_name)->sa_family;
+}
+
+static size_t send_packets(void)
+{
+    struct family_stats *family = NULL;
+    size_t sent = 0;
+    size_t end;
+    size_t retried = SIZE_MAX;
+    size_t syscalls = 0;
+    int fd;
+    int ret;
+
+    /* one batch per frame and address family, a failing packet is skipped so it doesn't hold back the other targets */
+    while (sent < num_packets) {
+        for (end = sent + 1; end < num_packets && packet_family(end) == packet_family(sent); end++)
+            ;
+
+        if (packet_family(sent) == AF_INET6) {
+            fd = udp6_fd;
+            family = &stats.ipv6;
+        } else {
+            fd = udp_fd;
+            family = &stats.ipv4;
+        }
+
+        while (sent < end) {
+            if (fd == -1) {
+                ret = -1;
+                errno = EAFNOSUPPORT;
+            } else {
+                /* a full send buffer is congestion, not something to wait for */
+                ret = sendmmsg(fd, msgs + sent, end - sent, MSG_DONTWAIT);
+                syscalls++;
+            }
+            if (ret > 0) {
+                sent += ret;
+                family->packets += ret;
+                continue;
+            }
+
+            /* the socket error may be an ICMP error for an earlier packet or the rest of a partial batch,
+             * failing once consumed it, so the packet gets a second try */
+            if (fd != -1 && retried != sent) {
+                retried = sent;
+                continue;
+            }
+
+            if (errno == EAGAIN || errno == ENOBUFS) {
+                rate.congested = true;
+                stats.congested++;
+            }
+            family->last_error = errno;
+            family->errors++;
+            msgs[sent++].msg_len = 0;
+        }
+    }
+
+    return syscalls;
+}
+
+static bool target_sent(const struct output_target *target)
+{
+    size_t i;
+
+    for (i = target->first_packet; i < target->first_packet + target->num_packets; i++) {
+        if (msgs[i].msg_len != iovs[i].iov_len)
+            return false;
+    }
+
+    return true;
+}
+
+void output_frame(const struct sockaddr_storage *addr, const char *frame, uint64_t now)
+{
+    output_frame_at(addr, frame, now, 0);
+}
+
+static void send_frame(const struct sockaddr_storage *addr, const char *frame, uint64_t now, uint64_t txtime)
+{
+    struct output_target *target = NULL;
+    const struct sockaddr_storage *dest = NULL;
+    uint64_t start, encoded, stage_start, stage_time;
+    size_t bytes;
+    size_t i, j;
+
+    num_packets = 0;
+
+    handle_errors(udp_fd, now);
+    handle_errors(udp6_fd, now);
+
+    /* a whole frame still waiting to go out means the link doesn't keep up,
+     * the queue counts buffer sizes, which are about twice the payload */
+    if (rate.last_bytes && queued_bytes() > 2 * rate.last_bytes) {
+        stats.queue_full++;
+        rate_backoff("send queue full", now);
+    }
+
+    /* the last frame before the game goes idle must not get lost */
+    if (rate_throttled(now)) {
+        if (frame != pending) {
+            memcpy(pending, frame, grid_width * grid_height * 3);
+            memcpy(&pending_addr, addr, sizeof(pending_addr));
+        }
+        pending_valid = true;
+        return;
+    }
+    pending_valid = false;
+
+    /* the error queue and the send queue aren't part of the encoding */
+    start = sched_now();
+
+    /* tiles and orientations are on the display, so the canvas is scaled first */
+    if (scaling) {
+        stage_start = sched_now();
+        scale_frame((const unsigned char *)frame, scaled);
+        frame = (const char *)scaled;
+        stage_time = sched_now() - stage_start;
+        stats.timing.scale += stage_time;
+        start += stage_time;
+    }
+
+    /* the receivers are sent the corrected colors, so they're what deltas are found in */
+    stage_start = sched_now();
+    if (color_frame((const unsigned char *)frame, colored, display_width * display_height))
+        frame = (const char *)colored;
+    stage_time = sched_now() - stage_start;
+    stats.timing.color += stage_time;
+    start += stage_time;
+
+    /* after the colors, they decide the current */
+    stage_start = sched_now();
+    if (power_frame((const unsigned char *)frame, colored, display_width * display_height, now))
+        frame = (const char *)colored;
+    stage_time = sched_now() - stage_start;
+    stats.timing.power += stage_time;
+    start += stage_time;
+
+    /* every target is encoded into the same batch, so all of them go out with one syscall */
+    for (i = 0; i < num_targets; i++) {
+        target = &targets[i];
+        target->first_packet = num_packets;
+        target->num_packets = 0;
+
+        dest = target->addr.ss_family != AF_UNSPEC ? &target->addr : addr;
+        if (! target->enabled || dest->ss_family == AF_UNSPEC)
+            continue;
+
+        if (target->min_interval && target->last_frame_valid && (now - target->last_send) < target->min_interval) {
+            target->stats.limited++;
+            continue;
+        }
+
+        slice_target(target, (const unsigned char *)frame);
+
+        /* the keepalive is a full frame, which also repairs any lost deltas */
+        target->keepalive = target->last_frame_valid && (now - target->last_send) >= OUTPUT_KEEPALIVE;
+
+        target->stream.addr = dest;
+        backend->encode_func(target->pixels, (target->keepalive || ! target->last_frame_valid) ? NULL : target->last_frame, target->num_leds, &target->stream);
+        target->num_packets = num_packets - target->first_packet;
+        if (! target->num_packets) {
+            target->stats.suppressed++;
+            stats.suppressed++;
+            continue;
+        }
+
+        /* backends may send some packets elsewhere, multicast groups for example */
+        for (j = target->first_packet; j < num_packets; j++) {
+            if (! msgs[j].msg_hdr.msg_name)
+                msgs[j].msg_hdr.msg_name = (void *)dest;
+            msgs[j].msg_hdr.msg_namelen = sizeof(*dest);
+            msgs[j].msg_len = 0;
+            set_txtime(j, txtime);
+        }
+    }
+
+    encoded = sched_now();
+    stats.timing.encode += encoded - start;
+
+    if (! num_packets)
+        return;
+
+    stats.timing.syscalls += send_packets();
+    stats.timing.send += sched_now() - encoded;
+    stats.timing.frames++;
+    stats.timing.packets += num_packets;
+
+    rate.last_bytes = 0;
+    for (j = 0; j < num_packets; j++) {
+        rate.last_bytes += iovs[j].iov_len;
+    }
+    if (rate.congested) {
+        rate.congested = false;
+        rate_backoff("send buffer full", now);
+    }
+
+    for (i = 0; i < num_targets; i++) {
+        target = &targets[i];
+        if (! target->num_packets)
+            continue;
+
+        /* the receiver may have only seen part of the frame, start over with a full one */
+        if (! target_sent(target)) {
+            target->stats.errors++;
+            stats.errors++;
+            target->last_frame_valid = false;
+            continue;
+        }
+
+        if (target->keepalive && memcmp(target->pixels, target->last_frame, target->num_leds * 3) == 0)
+            stats.keepalives++;
+
+        bytes = 0;
+        for (j = target->first_packet; j < target->first_packet + target->num_packets; j++) {
+            bytes += iovs[j].iov_len;
+        }
+        target->stats.bytes += bytes;
+        target->stats.sent++;
+        stats.bytes += bytes;
+        stats.sent++;
+
+        memcpy(target->last_frame, target->pixels, target->num_leds * 3);
+        target->last_frame_valid = true;
+        target->last_send = now;
+    }
+}
+
+void output_frame_at(const struct sockaddr_storage *addr, const char *frame, uint64_t now, uint64_t txtime)
+{
+    rate_source(now);
+    send_frame(addr, frame, now, txtime);
+}
+
+uint64_t output_pending(void)
+{
+    if (! pending_valid)
+        return 0;
+
+    return MAX(rate_next_send(), 1);
+}
+
+void output_send_pending(uint64_t now)
+{
+    /* not a frame from the game, so it doesn't count for the source rate */
+    if (pending_valid)
+        send_frame(&pending_addr, pending, now, 0);
+}
+
+void output_get_timing(struct output_timing *timing)
+{
+    memcpy(timing, &stats.timing, sizeof(*timing));
+}
+
+static void print_target_stats(const struct output_target *target)
+{
+    char address[ADDRESS_STRLEN] = { 0 };
+    char name[sizeof(address) + 8] = "default";
+
+    if (ip_format_address(&target->addr, address, sizeof(address))) {
+        if (target->addr.ss_family == AF_INET6)
+            snprintf(name, sizeof(name), "[%s]:%d", address, ntohs(((const struct sockaddr_in6 *)&target->addr)->sin6_port));
+        else
+            snprintf(name, sizeof(name), "%s:%d", address, ntohs(((const struct sockaddr_in *)&target->addr)->sin_port));
+    }
+
+    fprintf(stderr, "stats: output: %s %s %dx%d%s: sent: %" PRIu64 ", suppressed: %" PRIu64 ", rate limited: %" PRIu64 ", errors: %" PRIu64 ", unreachable: %" PRIu64 ", bytes: %" PRIu64 "\n",
+            target->mirror ? "mirror" : "tile",
+            name,
+            target->width,
+            target->height,
+            target->enabled ? "" : " (disabled)",
+            target->stats.sent,
+            target->stats.suppressed,
+            target->stats.limited,
+            target->stats.errors,
+            target->stats.unreachable,
+            target->stats.bytes);
+}
+
+static void print_family_stats(const char *name, const struct family_stats *family)
+{
+    if (! family->packets && ! family->errors)
+        return;
+
+    fprintf(stderr, "stats: output: %s: packets: %" PRIu64 ", send errors: %" PRIu64 "%s%s%s\n",
+            name,
+            family->packets,
+            family->errors,
+            family->last_error ? " (" : "",
+            family->last_error ? strerror(family->last_error) : "",
+            family->last_error ? ")" : "");
+}
+
+void output_print_stats(void)
+{
+    char limit[32] = "full";
+    size_t i;
+
+    fprintf(stderr, "stats: output: targets: %zu, sent: %" PRIu64 ", suppressed: %" PRIu64 ", keepalives: %" PRIu64 ", errors: %" PRIu64 ", unreachable: %" PRIu64 ", rediscoveries: %" PRIu64 ", bytes: %" PRIu64 " (%.1f per frame)\n",
+            num_targets,
+            stats.sent,
+            stats.suppressed,
+            stats.keepalives,
+            stats.errors,
+            stats.unreachable,
+            stats.rediscoveries,
+            stats.bytes,
+            stats.sent ? (double)stats.bytes / (double)stats.sent : 0.0);
+    if (rate.fps > 0.0)
+        snprintf(limit, sizeof(limit), "%.1f fps", rate.fps);
+    fprintf(stderr, "stats: output: rate: %s, backoffs: %" PRIu64 ", throttled: %" PRIu64 ", congested: %" PRIu64 ", queue full: %" PRIu64 "\n",
+            limit,
+            stats.backoffs,
+            stats.throttled,
+            stats.congested,
+            stats.queue_full);
+    fprintf(stderr, "stats: output: %s: scale: %.1f us, color: %.1f us, power: %.1f us, encode: %.1f us, send: %.1f us per frame, syscalls: %" PRIu64 ", brightness: %d%%\n",
+            backend->name,
+            stats.timing.frames ? ((double)stats.timing.scale / (double)stats.timing.frames) / 1000.0 : 0.0,
+            stats.timing.frames ? ((double)stats.timing.color / (double)stats.timing.frames) / 1000.0 : 0.0,
+            stats.timing.frames ? ((double)stats.timing.power / (double)stats.timing.frames) / 1000.0 : 0.0,
+            stats.timing.frames ? ((double)stats.timing.encode / (double)stats.timing.frames) / 1000.0 : 0.0,
+            stats.timing.frames ? ((double)stats.timing.send / (double)stats.timing.frames) / 1000.0 : 0.0,
+            stats.timing.syscalls,
+            color_get_brightness());
+    print_family_stats("ipv4", &stats.ipv4);
+    print_family_stats("ipv6", &stats.ipv6);
+    if (backend->print_stats_func) {
+        backend->print_stats_func();
+    }
+    power_print_stats();
+
+    for (i = 0; i < num_targets && num_targets > 1; i++) {
+        print_target_stats(&targets[i]);
+        memset(&targets[i].stats, '\0', sizeof(targets[i].stats));
+    }
+
+    memset(&stats, '\0', sizeof(stats));
+}
@@ -34,9 +34,17 @@ static int paddle_1_pos = 0;
 static int paddle_1_dir = MOVE_NONE;
 static int paddle_2_pos = 0;
 static int paddle_2_dir = MOVE_NONE;
+static int prev_paddle_1_pos = 0;
+static int prev_paddle_2_pos = 0;
+static int draw_paddle_1_pos = 0;
+static int draw_paddle_2_pos = 0;
 
 static double ball_y = 0.0;
 static double ball_x = 0.0;
+static double prev_ball_y = 0.0;
+static double prev_ball_x = 0.0;
+static double draw_ball_y = 0.0;
+static double draw_ball_x = 0.0;
 static double ball_dir = 0.0;
 
 static void setup_game(bool start)
@@ -53,9 +61,13 @@ static void setup_game(bool start)
     }
     paddle_1_dir = MOVE_NONE;
     paddle_2_dir = MOVE_NONE;
+    prev_paddle_1_pos = draw_paddle_1_pos = paddle_1_pos;
+    prev_paddle_2_pos = draw_paddle_2_pos = paddle_2_pos;
 
     ball_y = (double)(grid_height / 2);
     ball_x = (double)(grid_width / 2);
+    prev_ball_y = draw_ball_y = ball_y;
+    prev_ball_x = draw_ball_x = ball_x;
     if (grid_widescreen) {
         ball_dir = DIR_RIGHT;
     } else {
@@ -77,6 +89,11 @@ static bool doit(void)
 {
     double hit_offset;
 
+    prev_ball_y = ball_y;
+    prev_ball_x = ball_x;
+    prev_paddle_1_pos = paddle_1_pos;
+    prev_paddle_2_pos = paddle_2_pos;
+
     if (game_pause)
         return true;
 
@@ -229,6 +246,16 @@ static void tick(void)
         game_mode = MODE_DEAD;
 }
 
+static void interpolate(double phase)
+{
+    draw_ball_y = prev_ball_y + ((ball_y - prev_ball_y) * phase);
+    draw_ball_x = prev_ball_x + ((ball_x - prev_ball_x) * phase);
+
+    /* the paddles too, so they stay in step with the ball */
+    draw_paddle_1_pos = lround(prev_paddle_1_pos + ((paddle_1_pos - prev_paddle_1_pos) * phase));
+    draw_paddle_2_pos = lround(prev_paddle_2_pos + ((paddle_2_pos - prev_paddle_2_pos) * phase));
+}
+
 static void input(int player, int key_idx, bool key_val, int key_state)
 {
     int paddle_idx_1, paddle_idx_2;
@@ -308,28 +335,28 @@ static void draw(char *screen)
     if (grid_widescreen) {
         // 1. paddle
         for (y = 0; y < PADDLE_WIDTH; y++) {
-            set_pixel(screen, paddle_1_pos + y, PADDLE_1_X, COLOR_WHITE);
+            set_pixel(screen, draw_paddle_1_pos + y, PADDLE_1_X, COLOR_WHITE);
         }
 
         // 2. paddle
         for (y = 0; y < PADDLE_WIDTH; y++) {
-            set_pixel(screen, paddle_2_pos + y, PADDLE_2_X, COLOR_WHITE);
+            set_pixel(screen, draw_paddle_2_pos + y, PADDLE_2_X, COLOR_WHITE);
         }
     } else {
         // 1. paddle
         for (x = 0; x < PADDLE_WIDTH; x++) {
-            set_pixel(screen, PADDLE_1_Y, paddle_1_pos + x, COLOR_WHITE);
+            set_pixel(screen, PADDLE_1_Y, draw_paddle_1_pos + x, COLOR_WHITE);
         }
 
         // 2. paddle
         for (x = 0; x < PADDLE_WIDTH; x++) {
-            set_pixel(screen, PADDLE_2_Y, paddle_2_pos + x, COLOR_WHITE);
+            set_pixel(screen, PADDLE_2_Y, draw_paddle_2_pos + x, COLOR_WHITE);
         }
     }
 
     // ball
-    y = lround(ball_y);
-    x = lround(ball_x);
+    y = lround(draw_ball_y);
+    x = lround(draw_ball_x);
     if (y >= 0 && y < grid_height && x >= 0 && x < grid_width) {
         set_pixel(screen, y, x, COLOR_BLUE);
     }
@@ -355,11 +382,14 @@ const struct game pong_game = {
     true,
     false,
     0.1,
+    3,
+    CATCHUP_DROP,
     NULL,
     activate,
     deactivate,
     input,
     tick,
+    interpolate,
     render,
     idle,
 };
@@ -0,0 +1,171 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "matelight.h"
+
+// Power limiter
+//
+// The current a frame draws is estimated from the sum of all its channels,
+// every LED draws idle_ma and every channel up to channel_ma at 255. A
+// frame over the budget is scaled down so its channels fit, right away,
+// and the scale goes back up over POWER_RECOVERY, so the display doesn't
+// flicker between limited and full frames. Summing and scaling use SSE2 or
+// NEON where available, one 16 byte vector at a time.
+
+struct power_stats {
+    uint64_t frames;
+    uint64_t limited;               /* frames scaled down */
+    uint64_t events;                /* times the limit started */
+    uint64_t max_ma;
+    uint64_t total_ma;
+};
+
+static bool enabled = false;
+static unsigned int budget_ma = 0;
+static unsigned int channel_ma = POWER_CHANNEL_MA;
+static unsigned int idle_ma = POWER_IDLE_MA;
+
+static unsigned int scale = POWER_SCALE_ONE;
+static uint64_t last_frame = 0;
+
+static struct power_stats stats = { 0 };
+
+void power_init(unsigned int budget, unsigned int channel, unsigned int idle)
+{
+    enabled = budget > 0;
+    budget_ma = budget;
+    channel_ma = channel;
+    idle_ma = idle;
+}
+
+static uint64_t channel_sum(const unsigned char *pixels, size_t len)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i acc = _mm_setzero_si128();
+    uint64_t halves[2];
+
+    /* psadbw against zero adds up 8 bytes into each 64 bit half */
+    for (; i + 16 <= len; i += 16) {
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(pixels + i)), zero));
+    }
+    _mm_storeu_si128((__m128i *)halves, acc);
+    sum = halves[0] + halves[1];
+#elif defined(__ARM_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+
+    /* pairwise widening adds, a 32 bit lane takes 2^24 vectors before it overflows */
+    for (; i + 16 <= len; i += 16) {
+        acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(pixels + i)));
+    }
+    sum = (uint64_t)vgetq_lane_u32(acc, 0) + vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#endif
+
+    for (; i < len; i++) {
+        sum += pixels[i];
+    }
+
+    return sum;
+}
+
+/* dst = src * factor / 256, rounded, factor below 256 */
+static void scale_channels(const unsigned char *src, unsigned char *dst, size_t len, unsigned int factor)
+{
+    size_t i = 0;
+#if defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i mul = _mm_set1_epi16(factor);
+    __m128i round = _mm_set1_epi16(128);
+    __m128i v, lo, hi;
+
+    for (; i + 16 <= len; i += 16) {
+        v = _mm_loadu_si128((const __m128i *)(src + i));
+        lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(v, zero), mul), round), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(v, zero), mul), round), 8);
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(lo, hi));
+    }
+#elif defined(__ARM_NEON)
+    uint8x8_t mul = vdup_n_u8(factor);
+    uint8x16_t v;
+
+    for (; i + 16 <= len; i += 16) {
+        v = vld1q_u8(src + i);
+        vst1q_u8(dst + i, vcombine_u8(vrshrn_n_u16(vmull_u8(vget_low_u8(v), mul), 8),
+                                      vrshrn_n_u16(vmull_u8(vget_high_u8(v), mul), 8)));
+    }
+#endif
+
+    for (; i < len; i++) {
+        dst[i] = ((src[i] * factor) + 128) >> 8;
+    }
+}
+
+bool power_frame(const unsigned char *src, unsigned char *dst, size_t num_leds, uint64_t now)
+{
+    uint64_t sum, channels_ma, allowed_ma, needed, step;
+    uint64_t recovered = scale;
+    bool was_limited = scale < POWER_SCALE_ONE;
+
+    if (! enabled)
+        return false;
+
+    sum = channel_sum(src, num_leds * 3);
+    channels_ma = (sum * channel_ma) / 255;
+    allowed_ma = budget_ma > idle_ma * num_leds ? budget_ma - (idle_ma * num_leds) : 0;
+
+    stats.frames++;
+    stats.total_ma += channels_ma + (idle_ma * num_leds);
+    stats.max_ma = MAX(stats.max_ma, channels_ma + (idle_ma * num_leds));
+
+    /* down right away, the supply mustn't be overloaded, back up over POWER_RECOVERY */
+    needed = channels_ma > allowed_ma ? (allowed_ma * POWER_SCALE_ONE) / channels_ma : POWER_SCALE_ONE;
+    if (! last_frame) {
+        recovered = POWER_SCALE_ONE;
+        last_frame = now;
+    } else if (now > last_frame) {
+        /* frames closer than one step apart don't add a step each, the time is kept for the next frame */
+        step = ((now - last_frame) * POWER_SCALE_ONE) / POWER_RECOVERY;
+        recovered = scale + step;
+        last_frame += (step * POWER_RECOVERY) / POWER_SCALE_ONE;
+    }
+    scale = MIN(needed, MIN(recovered, POWER_SCALE_ONE));
+
+    if (scale >= POWER_SCALE_ONE)
+        return false;
+
+    stats.limited++;
+    if (! was_limited)
+        stats.events++;
+
+    scale_channels(src, dst, num_leds * 3, scale);
+    return true;
+}
+
+void power_print_stats(void)
+{
+    if (! enabled)
+        return;
+
+    fprintf(stderr, "stats: power: budget: %u mA, estimated: %.0f mA, max: %" PRIu64 " mA, limited frames: %" PRIu64 ", limit events: %" PRIu64 ", scale: %.0f%%\n",
+            budget_ma,
+            stats.frames ? (double)stats.total_ma / (double)stats.frames : 0.0,
+            stats.max_ma,
+            stats.limited,
+            stats.events,
+            (scale * 100.0) / POWER_SCALE_ONE);
+
+    memset(&stats, '\0', sizeof(stats));
+}
@@ -0,0 +1,77 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#include "matelight.h"
+
+// RGBW conversion
+//
+// The part of a color all three channels have in common is shown by the
+// white LED instead. white[] maps min(r, g, b) to the white level, which
+// is taken off the three channels again. The default is all of it, a
+// smaller percentage or an exponent above 1 leave pale colors to the RGB
+// LEDs. With NEON a linear curve converts 16 LEDs at a time, vld3 and
+// vst4 do the interleaving.
+
+static unsigned char white[256];
+static unsigned int factor = 256;   /* white = min * factor / 256 when the curve is linear */
+static bool linear = true;
+
+void rgbw_init(int percent, double exponent)
+{
+    double level;
+    unsigned int i;
+
+    linear = exponent == 1.0;
+    factor = (percent * 256) / 100;
+
+    /* a linear curve is rounded the way the vector code does it */
+    for (i = 0; i < 256; i++) {
+        level = 255.0 * (percent / 100.0) * pow((double)i / 255.0, exponent);
+        if (linear)
+            white[i] = factor < 256 ? ((i * factor) + 128) >> 8 : i;
+        else
+            white[i] = (unsigned char)MIN(lround(level), i);
+    }
+}
+
+void rgbw_convert(const unsigned char *rgb, unsigned char *rgbw, size_t num_leds)
+{
+    unsigned char w;
+    size_t i = 0;
+#if defined(__ARM_NEON)
+    uint8x16x3_t in;
+    uint8x16x4_t out;
+    uint8x8_t mul = vdup_n_u8(MIN(factor, 255));
+    uint8x16_t m;
+
+    for (; linear && i + 16 <= num_leds; i += 16) {
+        in = vld3q_u8(rgb + (i * 3));
+        m = vminq_u8(in.val[0], vminq_u8(in.val[1], in.val[2]));
+        if (factor < 256)
+            m = vcombine_u8(vrshrn_n_u16(vmull_u8(vget_low_u8(m), mul), 8),
+                            vrshrn_n_u16(vmull_u8(vget_high_u8(m), mul), 8));
+        out.val[0] = vsubq_u8(in.val[0], m);
+        out.val[1] = vsubq_u8(in.val[1], m);
+        out.val[2] = vsubq_u8(in.val[2], m);
+        out.val[3] = m;
+        vst4q_u8(rgbw + (i * 4), out);
+    }
+#endif
+
+    for (; i < num_leds; i++) {
+        w = white[MIN(rgb[(i * 3) + 0], MIN(rgb[(i * 3) + 1], rgb[(i * 3) + 2]))];
+        rgbw[(i * 4) + 0] = rgb[(i * 3) + 0] - w;
+        rgbw[(i * 4) + 1] = rgb[(i * 3) + 1] - w;
+        rgbw[(i * 4) + 2] = rgb[(i * 3) + 2] - w;
+        rgbw[(i * 4) + 3] = w;
+    }
+}
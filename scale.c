@@ -0,0 +1,231 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "matelight.h"
+
+// Output scaler
+//
+// Games draw on the grid_width x grid_height canvas, the display may have
+// a different size. Everything that depends on the two sizes is worked out
+// once, so scaling a frame is a table walk:
+//
+// - nearest and block give every display pixel one canvas pixel, or none
+//   for the black border around a block scaled canvas
+// - box gives every display pixel the canvas pixels it covers along each
+//   axis, with 8 bit weights summing to 256 per axis
+
+#define SCALE_BLACK     UINT32_MAX
+
+// Indexed by SCALE_*
+static const char *filter_names[] = { "nearest", "block", "box" };
+
+/* the canvas pixels covering each display pixel along one axis */
+struct scale_axis {
+    uint32_t *first;
+    uint32_t *count;
+    uint32_t *weight_idx;
+    uint16_t *weights;
+};
+
+static int filter = SCALE_NEAREST;
+static int src_width = 0;
+static int src_height = 0;
+static int dst_width = 0;
+static int dst_height = 0;
+
+static uint32_t *offsets = NULL;    /* nearest and block, frame offset of every display pixel */
+static struct scale_axis cols = { 0 };
+static struct scale_axis rows = { 0 };
+
+const char *scale_name(int scale_filter)
+{
+    if (scale_filter < 0 || (size_t)scale_filter >= ARRAY_LENGTH(filter_names))
+        return "unknown";
+
+    return filter_names[scale_filter];
+}
+
+int scale_find(const char *name)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LENGTH(filter_names); i++) {
+        if (strcmp(filter_names[i], name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static void *scale_alloc(size_t num, size_t size)
+{
+    void *ptr = calloc(num, size);
+
+    if (! ptr) {
+        perror("scale_init");
+        exit(EXIT_FAILURE);
+    }
+
+    return ptr;
+}
+
+static void free_axis(struct scale_axis *axis)
+{
+    free(axis->first);
+    free(axis->count);
+    free(axis->weight_idx);
+    free(axis->weights);
+    memset(axis, '\0', sizeof(*axis));
+}
+
+static void init_axis(struct scale_axis *axis, size_t src, size_t dst)
+{
+    size_t max_taps = (src / dst) + 2;
+    size_t start, end, pos, cover;
+    size_t i, j, n = 0;
+    unsigned int w, last_w;
+
+    axis->first = scale_alloc(dst, sizeof(*axis->first));
+    axis->count = scale_alloc(dst, sizeof(*axis->count));
+    axis->weight_idx = scale_alloc(dst, sizeof(*axis->weight_idx));
+    axis->weights = scale_alloc(dst * max_taps, sizeof(*axis->weights));
+
+    /* display pixel i covers [i * src, (i + 1) * src) and canvas pixel j covers [j * dst, (j + 1) * dst),
+     * both in 1/(src * dst) of the axis, weights are rounded on the running sum so they add up to 256 */
+    for (i = 0; i < dst; i++) {
+        start = i * src;
+        end = (i + 1) * src;
+        axis->first[i] = start / dst;
+        axis->weight_idx[i] = n;
+
+        cover = 0;
+        last_w = 0;
+        for (j = start / dst; j * dst < end; j++) {
+            pos = MIN(end, (j + 1) * dst);
+            cover += pos - MAX(start, j * dst);
+            w = ((cover * 256) + (src / 2)) / src;
+            axis->weights[n++] = w - last_w;
+            last_w = w;
+        }
+        axis->count[i] = n - axis->weight_idx[i];
+    }
+}
+
+static void init_offsets(void)
+{
+    int block, off_x, off_y;
+    int x, y, sx, sy;
+
+    offsets = scale_alloc(dst_width * dst_height, sizeof(*offsets));
+
+    /* the largest whole multiple that fits, centered */
+    block = MIN(dst_width / src_width, dst_height / src_height);
+    off_x = (dst_width - (src_width * block)) / 2;
+    off_y = (dst_height - (src_height * block)) / 2;
+
+    for (y = 0; y < dst_height; y++) {
+        for (x = 0; x < dst_width; x++) {
+            if (filter == SCALE_BLOCK) {
+                sx = x - off_x;
+                sy = y - off_y;
+                if (sx < 0 || sy < 0 || sx >= src_width * block || sy >= src_height * block) {
+                    offsets[(y * dst_width) + x] = SCALE_BLACK;
+                    continue;
+                }
+                sx /= block;
+                sy /= block;
+            } else {
+                /* the canvas pixel under the center of the display pixel */
+                sx = (((2 * x) + 1) * src_width) / (2 * dst_width);
+                sy = (((2 * y) + 1) * src_height) / (2 * dst_height);
+            }
+            offsets[(y * dst_width) + x] = ((sy * src_width) + sx) * 3;
+        }
+    }
+}
+
+bool scale_init(int width, int height, int scale_filter)
+{
+    free(offsets);
+    offsets = NULL;
+    free_axis(&cols);
+    free_axis(&rows);
+
+    if (scale_filter == SCALE_BLOCK && (width < grid_width || height < grid_height)) {
+        fprintf(stderr, "scale: block scaling needs a display of at least %dx%d\n", grid_width, grid_height);
+        return false;
+    }
+
+    filter = scale_filter;
+    src_width = grid_width;
+    src_height = grid_height;
+    dst_width = width;
+    dst_height = height;
+
+    if (filter == SCALE_BOX) {
+        init_axis(&cols, src_width, dst_width);
+        init_axis(&rows, src_height, dst_height);
+    } else {
+        init_offsets();
+    }
+
+    return true;
+}
+
+static void scale_gather(const unsigned char *src, unsigned char *dst)
+{
+    size_t num = dst_width * dst_height;
+    size_t i;
+
+    for (i = 0; i < num; i++) {
+        if (offsets[i] == SCALE_BLACK)
+            memset(dst + (i * 3), 0, 3);
+        else
+            memcpy(dst + (i * 3), src + offsets[i], 3);
+    }
+}
+
+static void scale_box(const unsigned char *src, unsigned char *dst)
+{
+    const unsigned char *row = NULL;
+    const unsigned char *pix = NULL;
+    const uint16_t *wy = NULL;
+    const uint16_t *wx = NULL;
+    uint32_t r, g, b, w;
+    uint32_t ty, tx;
+    int x, y;
+
+    /* 8 bit weights on both axes, so the sums need 24 bits */
+    for (y = 0; y < dst_height; y++) {
+        wy = rows.weights + rows.weight_idx[y];
+        for (x = 0; x < dst_width; x++) {
+            wx = cols.weights + cols.weight_idx[x];
+            r = g = b = 0;
+            for (ty = 0; ty < rows.count[y]; ty++) {
+                row = src + ((rows.first[y] + ty) * src_width * 3) + (cols.first[x] * 3);
+                for (tx = 0; tx < cols.count[x]; tx++) {
+                    w = wy[ty] * wx[tx];
+                    pix = row + (tx * 3);
+                    r += pix[0] * w;
+                    g += pix[1] * w;
+                    b += pix[2] * w;
+                }
+            }
+            *dst++ = (r + 32768) >> 16;
+            *dst++ = (g + 32768) >> 16;
+            *dst++ = (b + 32768) >> 16;
+        }
+    }
+}
+
+void scale_frame(const unsigned char *src, unsigned char *dst)
+{
+    if (filter == SCALE_BOX)
+        scale_box(src, dst);
+    else
+        scale_gather(src, dst);
+}
@@ -0,0 +1,213 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#include "matelight.h"
+
+#define MAX_SCHED_TIMERS    8
+
+struct sched_timer {
+    int fd;
+    uint64_t period;
+    uint64_t deadline;
+    bool running;
+    bool shared;
+};
+
+static struct sched_timer timers[MAX_SCHED_TIMERS];
+static size_t num_timers = 0;
+
+uint64_t sched_now(void)
+{
+    struct timespec ts = { 0 };
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * SCHED_NSEC_PER_SEC) + (uint64_t)ts.tv_nsec;
+}
+
+static void ns_to_timespec(uint64_t ns, struct timespec *ts)
+{
+    ts->tv_sec = (time_t)(ns / SCHED_NSEC_PER_SEC);
+    ts->tv_nsec = (long)(ns % SCHED_NSEC_PER_SEC);
+}
+
+static void timer_event(int fd, unsigned int events, void *arg)
+{
+    uint64_t expirations;
+
+    (void)events;
+    (void)arg;
+
+    /* expired deadlines are accounted for by sched_timer_expired() */
+    (void)read(fd, &expirations, sizeof(expirations));
+}
+
+static struct sched_timer *new_timer(uint64_t period, bool shared)
+{
+    struct sched_timer *timer = NULL;
+
+    if (period == 0)
+        return NULL;
+
+    if (num_timers >= MAX_SCHED_TIMERS) {
+        fprintf(stderr, "sched: too many timers\n");
+        return NULL;
+    }
+
+    timer = &timers[num_timers];
+    timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer->fd == -1) {
+        perror("timerfd_create");
+        return NULL;
+    }
+    if (! event_add(timer->fd, timer_event, timer)) {
+        close(timer->fd);
+        timer->fd = -1;
+        return NULL;
+    }
+    timer->period = period;
+    timer->deadline = 0;
+    timer->running = false;
+    timer->shared = shared;
+    num_timers++;
+
+    return timer;
+}
+
+struct sched_timer *sched_timer_new(uint64_t period)
+{
+    return new_timer(period, false);
+}
+
+struct sched_timer *sched_timer_get(uint64_t period)
+{
+    size_t i;
+
+    /* one timer per tick rate, games with the same tick rate share it */
+    for (i = 0; i < num_timers; i++) {
+        if (timers[i].shared && timers[i].period == period)
+            return &timers[i];
+    }
+
+    return new_timer(period, true);
+}
+
+void sched_timer_start(struct sched_timer *timer, uint64_t now)
+{
+    struct itimerspec its = { 0 };
+
+    if (! timer)
+        return;
+
+    timer->deadline = now + timer->period;
+    timer->running = true;
+
+    /* absolute periodic timer, so the kernel keeps the same phase as the deadlines */
+    ns_to_timespec(timer->deadline, &its.it_value);
+    ns_to_timespec(timer->period, &its.it_interval);
+    if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &its, NULL) != 0) {
+        perror("timerfd_settime");
+    }
+}
+
+void sched_timer_stop(struct sched_timer *timer)
+{
+    struct itimerspec its = { 0 };
+
+    if (! timer || ! timer->running)
+        return;
+
+    timer->running = false;
+
+    if (timerfd_settime(timer->fd, 0, &its, NULL) != 0) {
+        perror("timerfd_settime");
+    }
+}
+
+bool sched_timer_running(const struct sched_timer *timer)
+{
+    return timer && timer->running;
+}
+
+bool sched_timer_expired(struct sched_timer *timer, uint64_t now)
+{
+    if (! timer || ! timer->running)
+        return false;
+
+    if (now < timer->deadline)
+        return false;
+
+    timer->deadline += timer->period;
+    return true;
+}
+
+bool sched_timer_due(const struct sched_timer *timer, uint64_t now)
+{
+    return timer && timer->running && now >= timer->deadline;
+}
+
+uint64_t sched_timer_lag(const struct sched_timer *timer, uint64_t now)
+{
+    if (! sched_timer_due(timer, now))
+        return 0;
+
+    return now - timer->deadline;
+}
+
+uint64_t sched_timer_skip(struct sched_timer *timer, uint64_t now)
+{
+    uint64_t skipped;
+
+    if (! sched_timer_due(timer, now))
+        return 0;
+
+    /* keep the phase, the next deadline is the first one after now */
+    skipped = ((now - timer->deadline) / timer->period) + 1;
+    timer->deadline += skipped * timer->period;
+
+    return skipped;
+}
+
+uint64_t sched_timer_delay(struct sched_timer *timer, uint64_t now)
+{
+    uint64_t delayed;
+
+    if (! sched_timer_due(timer, now))
+        return 0;
+
+    /* the due deadlines move along, the next one is a period from now */
+    delayed = ((now - timer->deadline) / timer->period) + 1;
+    sched_timer_start(timer, now);
+
+    return delayed;
+}
+
+double sched_timer_phase(const struct sched_timer *timer, uint64_t now)
+{
+    uint64_t last;
+
+    if (! timer || ! timer->running)
+        return 0.0;
+
+    last = timer->deadline - timer->period;
+    if (now <= last)
+        return 0.0;
+    if (now >= timer->deadline)
+        return 1.0;
+
+    return (double)(now - last) / (double)timer->period;
+}
+
+uint64_t sched_timer_last_deadline(const struct sched_timer *timer)
+{
+    if (! timer || ! timer->running)
+        return 0;
+
+    return timer->deadline - timer->period;
+}
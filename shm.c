@@ -0,0 +1,104 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "matelight.h"
+
+// Shared memory frame sink
+//
+// Local consumers map /dev/shm/<name> read-only and get every shown frame
+// without sockets or copies. The writer never waits for them:
+//
+// - header->sequence is the last complete frame, it's in slot sequence % num_slots
+// - a slot's sequence is 0 while it's being written, a reader that sees the
+//   same sequence before and after reading a slot got a consistent frame
+// - header->futex changes with every frame, readers FUTEX_WAIT on it
+
+#define SHM_SLOT_ALIGN  64
+
+static struct shm_header *header = NULL;
+static size_t frame_size = 0;
+
+static struct shm_slot *get_slot(uint64_t sequence)
+{
+    return (struct shm_slot *)((unsigned char *)header + sizeof(*header) + ((sequence % header->num_slots) * header->slot_size));
+}
+
+void shm_init(const char *name)
+{
+    char path[NAME_MAX];
+    size_t slot_size, size;
+    int fd;
+
+    snprintf(path, sizeof(path), "/%s", name);
+
+    frame_size = grid_width * grid_height * 3;
+    slot_size = (sizeof(struct shm_slot) + frame_size + SHM_SLOT_ALIGN - 1) & ~(size_t)(SHM_SLOT_ALIGN - 1);
+    size = sizeof(struct shm_header) + (SHM_SLOTS * slot_size);
+
+    /* readers still mapping a previous run's segment keep it, new readers get this one */
+    (void)shm_unlink(path);
+    fd = shm_open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd == -1) {
+        perror("shm_open");
+        exit(EXIT_FAILURE);
+    }
+
+    if (ftruncate(fd, size) == -1) {
+        perror("ftruncate");
+        exit(EXIT_FAILURE);
+    }
+
+    header = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (header == MAP_FAILED) {
+        perror("mmap");
+        exit(EXIT_FAILURE);
+    }
+    close(fd);
+
+    header->version = SHM_VERSION;
+    header->width = grid_width;
+    header->height = grid_height;
+    header->num_slots = SHM_SLOTS;
+    header->slot_size = slot_size;
+    header->sequence = 0;
+    header->futex = 0;
+
+    /* readers check the magic last, everything else is valid once it's there */
+    __atomic_store_n(&header->magic, SHM_MAGIC, __ATOMIC_RELEASE);
+}
+
+void shm_frame(const char *frame, uint64_t now)
+{
+    uint64_t sequence;
+    struct shm_slot *slot;
+
+    if (! header)
+        return;
+
+    sequence = header->sequence + 1;
+    slot = get_slot(sequence);
+
+    __atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    slot->timestamp = now;
+    memcpy(slot->pixels, frame, frame_size);
+
+    __atomic_store_n(&slot->sequence, sequence, __ATOMIC_RELEASE);
+    __atomic_store_n(&header->sequence, sequence, __ATOMIC_RELEASE);
+
+    /* waking nobody is cheap, keeping track of waiters would need a writable mapping in every reader */
+    __atomic_add_fetch(&header->futex, 1, __ATOMIC_RELEASE);
+    (void)syscall(SYS_futex, &header->futex, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
@@ -1,4 +1,5 @@
 #include <stddef.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -52,9 +53,10 @@ static int numpoison;
 static int rotatecnt;
 static int snakelen;
 static int wantedlen;
-static unsigned char grid[MAX_GRID_SIZE];
-static unsigned char snake[MAX_GRID_SIZE * 2];
-static unsigned char objs[MAX_GRID_SIZE * 2];
+static size_t grid_size;
+static unsigned char *grid = NULL;
+static int *snake = NULL;
+static int *objs = NULL;
 
 static void grid_set(int y, int x, unsigned char type)
 {
@@ -155,9 +157,9 @@ static void setup_game(bool start)
     rotatecnt = 0;
     snakelen = 0;
     wantedlen = SNAKE_START;
-    memset(grid, '\0', sizeof(grid));
-    memset(snake, '\0', sizeof(snake));
-    memset(objs, '\0', sizeof(objs));
+    memset(grid, '\0', grid_size * sizeof(*grid));
+    memset(snake, '\0', grid_size * 2 * sizeof(*snake));
+    memset(objs, '\0', grid_size * 2 * sizeof(*objs));
 
     if (game_level) {
         for (x = 0; x < grid_width; x++) {
@@ -173,6 +175,19 @@ static void setup_game(bool start)
     add_object(OBJ_SNAKEHEAD);
 }
 
+static void init(void)
+{
+    grid_size = grid_width * grid_height;
+
+    grid = calloc(grid_size, sizeof(*grid));
+    snake = calloc(grid_size * 2, sizeof(*snake));
+    objs = calloc(grid_size * 2, sizeof(*objs));
+    if (! grid || ! snake || ! objs) {
+        perror("snake");
+        exit(EXIT_FAILURE);
+    }
+}
+
 static void activate(bool start)
 {
     setup_game(start);
@@ -465,11 +480,14 @@ const struct game snake_game = {
     true,
     false,
     0.1,
-    NULL,
+    3,
+    CATCHUP_DROP,
+    init,
     activate,
     deactivate,
     input,
     tick,
+    NULL,
     render,
     idle,
 };
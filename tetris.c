@@ -2,6 +2,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
@@ -247,7 +248,7 @@ static const struct tetris_block_rotations tetris_blocks_rotations[TETRIS_NUM_BR
     }
 };
 
-typedef int tetris_field[MAX_GRID_SIZE];
+typedef int *tetris_field;
 
 struct tetris {
     tetris_field field;
@@ -267,6 +268,18 @@ static double pause_start = 0.0;
 static struct tetris _tetris = { 0 };
 static struct tetris *tetris = &_tetris;
 
+/* fields are sized for the grid at startup, these are scratch fields for the current block */
+static size_t field_size = 0;
+static tetris_field field_buf = NULL;
+static tetris_field block_buf = NULL;
+static tetris_field draw_buf = NULL;
+
+static tetris_field clear_field(tetris_field field)
+{
+    memset(field, '\0', field_size * sizeof(*field));
+    return field;
+}
+
 static void setup_game(bool start)
 {
     int x, y;
@@ -276,6 +289,7 @@ static void setup_game(bool start)
     pause_start = 0.0;
 
     memset(tetris, '\0', sizeof(*tetris));
+    tetris->field = clear_field(field_buf);
 
     for (x = 0; x < TETRIS_WIDTH; ++x) {
         for (y = 0; y < TETRIS_HEIGHT; ++y) {
@@ -295,6 +309,22 @@ static void setup_game(bool start)
     tetris->level = 0;
 }
 
+static void init(void)
+{
+    field_size = TETRIS_WIDTH * TETRIS_HEIGHT;
+
+    field_buf = calloc(field_size, sizeof(*field_buf));
+    /* block_landed() looks one row beyond the top of the block field */
+    block_buf = calloc(field_size + TETRIS_WIDTH, sizeof(*block_buf));
+    draw_buf = calloc(field_size, sizeof(*draw_buf));
+    if (! field_buf || ! block_buf || ! draw_buf) {
+        perror("tetris");
+        exit(EXIT_FAILURE);
+    }
+
+    tetris->field = field_buf;
+}
+
 static void activate(bool start)
 {
     setup_game(start);
@@ -335,7 +365,7 @@ static void write_block(tetris_field field, int i, int r, int x, int y)
 static bool valid_block(tetris_field tstfield, int i, int r, int x, int y)
 {
     int px, py;
-    tetris_field curblock = { 0 };
+    tetris_field curblock = clear_field(block_buf);
 
     for (px = 0; px < 4; ++px) {
         for (py = 0; py < 4; ++py) {
@@ -366,7 +396,7 @@ static bool block_landed(void)
 {
     int x, y;
 
-    tetris_field curblock = { 0 };
+    tetris_field curblock = clear_field(block_buf);
 
     write_block(curblock, tetris->curblock, tetris->rotation, tetris->curblock_x, tetris->curblock_y);
 
@@ -388,7 +418,7 @@ static bool block_crashed(void)
 {
     int x, y;
 
-    tetris_field curblock = { 0 };
+    tetris_field curblock = clear_field(block_buf);
 
     write_block(curblock, tetris->curblock, tetris->rotation, tetris->curblock_x, tetris->curblock_y);
 
@@ -487,7 +517,7 @@ static bool doit(void)
 
     if (time_val >= tetris->next_update) {
         if (block_landed()) {
-            tetris_field curblock = { 0 };
+            tetris_field curblock = clear_field(block_buf);
             int nt;
 
             write_block(curblock, tetris->curblock, tetris->rotation, tetris->curblock_x, tetris->curblock_y);
@@ -530,8 +560,8 @@ static void draw(char *screen)
 {
     int x, y;
 
-    tetris_field field = { 0 };
-    tetris_field curblock = { 0 };
+    tetris_field field = draw_buf;
+    tetris_field curblock = clear_field(block_buf);
 
     for (y = 0; y < grid_height; y++) {
         for (x = 0; x < grid_width; x++) {
@@ -540,7 +570,7 @@ static void draw(char *screen)
     }
 
     write_block(curblock, tetris->curblock, tetris->rotation, tetris->curblock_x, tetris->curblock_y);
-    memcpy(field, tetris->field, sizeof(field));
+    memcpy(field, tetris->field, field_size * sizeof(*field));
     field_apply(field, curblock);
 
     /* playfield */
@@ -634,11 +664,14 @@ const struct game tetris_game = {
     true,
     false,
     0.1,
-    NULL,
+    3,
+    CATCHUP_DROP,
+    init,
     activate,
     deactivate,
     input,
     tick,
+    NULL,
     render,
     idle,
 };
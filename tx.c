@@ -0,0 +1,280 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "matelight.h"
+
+// Paced transmit thread
+//
+// The main loop renders a frame when it's due, but how late that is depends
+// on input and the game. Frames are handed to this thread instead, which
+// sends each one TX_DELAY after its frame deadline, so the gaps WLED sees
+// are the frame period. The main loop never waits for it:
+//
+// - three frame buffers, the main loop fills one, this thread sends one,
+//   and the third is the latest finished frame
+// - ready holds the index of the latest frame, with TX_FRESH until it's taken
+// - a frame replaced before it was taken is never sent
+// - wakeups changes with every frame and request, this thread FUTEX_WAITs on it
+
+#define TX_FRESH        4
+#define TX_RESET        (1 << 0)
+#define TX_MIRRORS      (1 << 1)
+#define TX_STATS        (1 << 2)
+
+struct tx_frame {
+    uint64_t deadline;              /* 0 sends it right away */
+    struct sockaddr_storage addr;
+    char *pixels;
+};
+
+struct tx_stats {
+    uint64_t frames;
+    uint64_t late;
+    uint64_t last_send;
+    uint64_t intervals;
+    double interval_mean;
+    double interval_m2;
+    uint64_t interval_max;
+    uint64_t lateness;
+    uint64_t lateness_max;
+};
+
+static pthread_t tx_thread;
+static bool running = false;
+static bool txtime = false;
+
+static struct tx_frame frames[3];
+static int back = 0;                /* main loop */
+static int front = 1;               /* tx thread */
+static int ready = 2;
+
+static uint32_t wakeups = 0;
+static unsigned int requests = 0;
+static bool mirrors_enabled = true;
+static uint64_t superseded = 0;
+
+static struct tx_stats stats = { 0 };
+
+static void wake(void)
+{
+    __atomic_add_fetch(&wakeups, 1, __ATOMIC_RELEASE);
+    (void)syscall(SYS_futex, &wakeups, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+static void request(unsigned int req)
+{
+    __atomic_or_fetch(&requests, req, __ATOMIC_RELEASE);
+    wake();
+}
+
+static void sleep_until(uint64_t deadline)
+{
+    struct timespec ts;
+
+    ts.tv_sec = (time_t)(deadline / SCHED_NSEC_PER_SEC);
+    ts.tv_nsec = (long)(deadline % SCHED_NSEC_PER_SEC);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+static void print_stats(void)
+{
+    double jitter = 0.0;
+
+    if (stats.intervals > 1)
+        jitter = sqrt(stats.interval_m2 / (double)(stats.intervals - 1));
+
+    fprintf(stderr, "stats: tx: frames: %" PRIu64 ", superseded: %" PRIu64 ", late: %" PRIu64 ", send interval: %.2f ms, jitter: %.3f ms, max interval: %.2f ms, lateness: %.3f ms, max lateness: %.3f ms%s\n",
+            stats.frames,
+            __atomic_exchange_n(&superseded, 0, __ATOMIC_RELAXED),
+            stats.late,
+            stats.interval_mean / 1000000.0,
+            jitter / 1000000.0,
+            (double)stats.interval_max / 1000000.0,
+            stats.frames ? ((double)stats.lateness / (double)stats.frames) / 1000000.0 : 0.0,
+            (double)stats.lateness_max / 1000000.0,
+            txtime ? " (txtime, scheduled send times, jitter not measured)" : "");
+
+    memset(&stats, '\0', sizeof(stats));
+}
+
+static void handle_requests(void)
+{
+    unsigned int req = __atomic_exchange_n(&requests, 0, __ATOMIC_ACQUIRE);
+
+    if (req & TX_RESET)
+        output_reset();
+    if (req & TX_MIRRORS)
+        output_enable_mirrors(__atomic_load_n(&mirrors_enabled, __ATOMIC_RELAXED));
+    if (req & TX_STATS) {
+        output_print_stats();
+        print_stats();
+    }
+}
+
+static void update_stats(uint64_t send_at, uint64_t now)
+{
+    uint64_t interval;
+    double delta;
+
+    stats.frames++;
+
+    if (now > send_at) {
+        stats.lateness += now - send_at;
+        if (now - send_at > stats.lateness_max)
+            stats.lateness_max = now - send_at;
+    }
+
+    /* the pause between games isn't jitter, frames are at most a second apart while they're shown */
+    if (stats.last_send && now - stats.last_send < SCHED_NSEC_PER_SEC) {
+        interval = now - stats.last_send;
+        stats.intervals++;
+        delta = (double)interval - stats.interval_mean;
+        stats.interval_mean += delta / (double)stats.intervals;
+        stats.interval_m2 += delta * ((double)interval - stats.interval_mean);
+        if (interval > stats.interval_max)
+            stats.interval_max = interval;
+    }
+
+    stats.last_send = now;
+}
+
+static void *tx_thread_func(void *arg)
+{
+    struct tx_frame *frame = NULL;
+    struct timespec timeout;
+    uint32_t seen;
+    uint64_t send_at, sent, now, pending;
+
+    (void)arg;
+
+    for (;;) {
+        seen = __atomic_load_n(&wakeups, __ATOMIC_ACQUIRE);
+        handle_requests();
+
+        /* a frame held back by the rate control goes out when it may, unless a newer one comes first */
+        if (! (__atomic_load_n(&ready, __ATOMIC_ACQUIRE) & TX_FRESH)) {
+            pending = output_pending();
+            now = sched_now();
+            if (pending && now >= pending) {
+                output_send_pending(now);
+            } else if (pending) {
+                timeout.tv_sec = (time_t)((pending - now) / SCHED_NSEC_PER_SEC);
+                timeout.tv_nsec = (long)((pending - now) % SCHED_NSEC_PER_SEC);
+                (void)syscall(SYS_futex, &wakeups, FUTEX_WAIT_PRIVATE, seen, &timeout, NULL, 0);
+            } else {
+                (void)syscall(SYS_futex, &wakeups, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+            }
+            continue;
+        }
+
+        front = __atomic_exchange_n(&ready, front, __ATOMIC_ACQ_REL) & ~TX_FRESH;
+        frame = &frames[front];
+
+        /* with SO_TXTIME the kernel holds the packets until the deadline, so they're handed over a bit early */
+        now = sched_now();
+        send_at = frame->deadline ? frame->deadline + TX_DELAY : now;
+        if (now >= send_at && frame->deadline)
+            stats.late++;
+        else if (now < send_at)
+            sleep_until(txtime ? send_at - TX_TXTIME_LEAD : send_at);
+
+        /* a reset has to happen before the frame for the new controller */
+        handle_requests();
+
+        /* with SO_TXTIME the packets leave at send_at, unless they were handed over too late */
+        now = sched_now();
+        sent = txtime && now < send_at ? send_at : now;
+        update_stats(send_at, sent);
+        output_frame_at(&frame->addr, frame->pixels, now, txtime ? send_at : 0);
+    }
+
+    return NULL;
+}
+
+void tx_init(bool use_txtime)
+{
+    size_t i;
+
+    for (i = 0; i < ARRAY_LENGTH(frames); i++) {
+        frames[i].pixels = calloc(grid_width * grid_height, 3);
+        if (! frames[i].pixels) {
+            perror("tx_init");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    txtime = use_txtime && output_enable_txtime();
+
+    if (pthread_create(&tx_thread, NULL, tx_thread_func, NULL) != 0) {
+        perror("pthread_create");
+        exit(EXIT_FAILURE);
+    }
+
+    (void)pthread_detach(tx_thread);
+    running = true;
+}
+
+void tx_frame(const struct sockaddr_storage *addr, const char *pixels, uint64_t deadline)
+{
+    int prev;
+
+    if (! running) {
+        output_frame(addr, pixels, sched_now());
+        return;
+    }
+
+    memcpy(&frames[back].addr, addr, sizeof(frames[back].addr));
+    memcpy(frames[back].pixels, pixels, grid_width * grid_height * 3);
+    frames[back].deadline = deadline;
+
+    prev = __atomic_exchange_n(&ready, back | TX_FRESH, __ATOMIC_ACQ_REL);
+    if (prev & TX_FRESH)
+        __atomic_add_fetch(&superseded, 1, __ATOMIC_RELAXED);
+    back = prev & ~TX_FRESH;
+
+    wake();
+}
+
+void tx_reset(void)
+{
+    if (! running) {
+        output_reset();
+        return;
+    }
+
+    request(TX_RESET);
+}
+
+void tx_enable_mirrors(bool enabled)
+{
+    if (! running) {
+        output_enable_mirrors(enabled);
+        return;
+    }
+
+    __atomic_store_n(&mirrors_enabled, enabled, __ATOMIC_RELAXED);
+    request(TX_MIRRORS);
+}
+
+void tx_print_stats(void)
+{
+    if (! running) {
+        output_print_stats();
+        return;
+    }
+
+    request(TX_STATS);
+}
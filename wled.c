@@ -0,0 +1,202 @@
+#include <stddef.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "matelight.h"
+
+// WLED UDP realtime, https://kno.wled.ge/interfaces/udp-realtime/
+
+// Packet headers
+#define WARLS_HEADER_SIZE   2
+#define DRGB_HEADER_SIZE    2
+#define DRGBW_HEADER_SIZE   2
+#define DNRGB_HEADER_SIZE   4
+
+// WARLS can only address the first 256 LEDs
+#define WARLS_MAX_INDEX     255
+
+// Changed LEDs closer than this are sent in one DNRGB run instead of starting a new packet
+#define DNRGB_RUN_GAP       ((DNRGB_HEADER_SIZE + OUTPUT_UDP_OVERHEAD) / 3)
+
+struct wled_stats {
+    uint64_t drgb;
+    uint64_t drgbw;
+    uint64_t dnrgb;
+    uint64_t warls;
+};
+
+static struct wled_stats stats = { 0 };
+
+/* packets to IPv6 addresses are smaller, so they aren't fragmented */
+static size_t drgb_max_leds(const struct output_stream *stream)
+{
+    return stream->addr->ss_family == AF_INET6 ? WLED_DRGB_MAX_LEDS6 : WLED_DRGB_MAX_LEDS;
+}
+
+static size_t dnrgb_max_leds(const struct output_stream *stream)
+{
+    return stream->addr->ss_family == AF_INET6 ? WLED_DNRGB_MAX_LEDS6 : WLED_DNRGB_MAX_LEDS;
+}
+
+static size_t max_packets(size_t num_leds)
+{
+    return MAX((num_leds + WLED_DNRGB_MAX_LEDS6 - 1) / WLED_DNRGB_MAX_LEDS6, OUTPUT_MAX_DELTA_RUNS);
+}
+
+static void encode_drgb(const unsigned char *pixels, size_t num_leds)
+{
+    unsigned char *packet = output_new_packet(DRGB_HEADER_SIZE + (num_leds * 3));
+
+    packet[0] = WLED_DRGB;
+    packet[1] = DISPLAY_TIMEOUT;
+    memcpy(packet + DRGB_HEADER_SIZE, pixels, num_leds * 3);
+    stats.drgb++;
+}
+
+static void encode_drgbw(const unsigned char *pixels, size_t num_leds)
+{
+    unsigned char *packet = output_new_packet(DRGBW_HEADER_SIZE + (num_leds * 4));
+
+    packet[0] = WLED_DRGBW;
+    packet[1] = DISPLAY_TIMEOUT;
+    rgbw_convert(pixels, packet + DRGBW_HEADER_SIZE, num_leds);
+    stats.drgbw++;
+}
+
+static void encode_dnrgb(const unsigned char *pixels, size_t first, size_t last, size_t max_leds)
+{
+    unsigned char *packet;
+    size_t len;
+
+    /* the range is split into packets of at most max_leds */
+    for (; first <= last; first += len) {
+        len = MIN((last - first) + 1, max_leds);
+        packet = output_new_packet(DNRGB_HEADER_SIZE + (len * 3));
+        packet[0] = WLED_DNRGB;
+        packet[1] = DISPLAY_TIMEOUT;
+        packet[2] = (first >> 8) & 0xff;
+        packet[3] = first & 0xff;
+        memcpy(packet + DNRGB_HEADER_SIZE, pixels + (first * 3), len * 3);
+        stats.dnrgb++;
+    }
+}
+
+static void encode_warls(const unsigned char *pixels, const unsigned char *last_frame, size_t first, size_t last, size_t changed)
+{
+    size_t i;
+    unsigned char *packet = output_new_packet(WARLS_HEADER_SIZE + (changed * 4));
+
+    packet[0] = WLED_WARLS;
+    packet[1] = DISPLAY_TIMEOUT;
+    packet += WARLS_HEADER_SIZE;
+    for (i = first; i <= last; i++) {
+        if (memcmp(pixels + (i * 3), last_frame + (i * 3), 3) == 0)
+            continue;
+        packet[0] = i;
+        memcpy(packet + 1, pixels + (i * 3), 3);
+        packet += 4;
+    }
+    stats.warls++;
+}
+
+static size_t dnrgb_cost(size_t first, size_t last, size_t max_leds)
+{
+    size_t len = (last - first) + 1;
+    size_t n = (len + max_leds - 1) / max_leds;
+
+    return (n * (OUTPUT_UDP_OVERHEAD + DNRGB_HEADER_SIZE)) + (len * 3);
+}
+
+static void encode_full(const unsigned char *pixels, size_t num_leds, const struct output_stream *stream)
+{
+    if (num_leds <= drgb_max_leds(stream)) {
+        encode_drgb(pixels, num_leds);
+    } else {
+        encode_dnrgb(pixels, 0, num_leds - 1, dnrgb_max_leds(stream));
+    }
+}
+
+static void encode(const unsigned char *pixels, const unsigned char *last_frame, size_t num_leds, struct output_stream *stream)
+{
+    struct output_delta delta;
+    const struct output_run *runs = delta.runs;
+    size_t full_cost, runs_cost, range_cost, warls_cost;
+    size_t max_leds = dnrgb_max_leds(stream);
+    size_t first, last;
+    size_t i;
+
+    /* DRGBW can't send part of a frame */
+    if (stream->rgbw) {
+        if (! last_frame || memcmp(pixels, last_frame, num_leds * 3) != 0)
+            encode_drgbw(pixels, num_leds);
+        return;
+    }
+
+    if (! last_frame) {
+        encode_full(pixels, num_leds, stream);
+        return;
+    }
+
+    output_find_delta(pixels, last_frame, num_leds, DNRGB_RUN_GAP, max_leds, &delta);
+    if (! delta.changed)
+        return;
+
+    first = runs[0].first;
+    last = runs[delta.num_runs - 1].last;
+
+    /* pick whichever encoding puts the fewest bytes on the wire */
+    if (num_leds <= drgb_max_leds(stream))
+        full_cost = OUTPUT_UDP_OVERHEAD + DRGB_HEADER_SIZE + (num_leds * 3);
+    else
+        full_cost = dnrgb_cost(0, num_leds - 1, max_leds);
+
+    range_cost = dnrgb_cost(first, last, max_leds);
+
+    runs_cost = SIZE_MAX;
+    if (! delta.too_many_runs) {
+        runs_cost = 0;
+        for (i = 0; i < delta.num_runs; i++) {
+            runs_cost += dnrgb_cost(runs[i].first, runs[i].last, max_leds);
+        }
+    }
+
+    warls_cost = SIZE_MAX;
+    if (last <= WARLS_MAX_INDEX)
+        warls_cost = OUTPUT_UDP_OVERHEAD + WARLS_HEADER_SIZE + (delta.changed * 4);
+
+    if (warls_cost < full_cost && warls_cost <= runs_cost && warls_cost <= range_cost) {
+        encode_warls(pixels, last_frame, first, last, delta.changed);
+    } else if (runs_cost < full_cost && runs_cost <= range_cost) {
+        for (i = 0; i < delta.num_runs; i++) {
+            encode_dnrgb(pixels, runs[i].first, runs[i].last, max_leds);
+        }
+    } else if (range_cost < full_cost) {
+        encode_dnrgb(pixels, first, last, max_leds);
+    } else {
+        encode_full(pixels, num_leds, stream);
+    }
+}
+
+static void print_stats(void)
+{
+    fprintf(stderr, "stats: output: wled: drgb: %" PRIu64 ", drgbw: %" PRIu64 ", dnrgb: %" PRIu64 ", warls: %" PRIu64 "\n",
+            stats.drgb,
+            stats.drgbw,
+            stats.dnrgb,
+            stats.warls);
+
+    memset(&stats, '\0', sizeof(stats));
+}
+
+const struct output_backend wled_backend = {
+    "wled",
+    21324,
+    NULL,
+    NULL,
+    max_packets,
+    encode,
+    print_stats,
+};
@@ -70,13 +70,22 @@ bool wled_xml_check(struct MemoryStruct *chunk)
 
 bool wled_api_check(const char *addr)
 {
-    char url[7 + MAX(INET_ADDRSTRLEN, INET6_ADDRSTRLEN) + 4 + 1];
+    char url[7 + 2 + ADDRESS_STRLEN + 2 + 4 + 1];
+    const char *scope = NULL;
     CURL *curl_handle;
     struct MemoryStruct chunk = { NULL, 0 };
     CURLcode res;
     bool xmlok = false;
 
-    snprintf(url, sizeof(url), "http://%s/win", addr);
+    /* IPv6 addresses go in brackets, and the % of a zone id is escaped in URLs */
+    scope = strchr(addr, '%');
+    if (scope) {
+        snprintf(url, sizeof(url), "http://[%.*s%%25%s]/win", (int)(scope - addr), addr, scope + 1);
+    } else if (strchr(addr, ':')) {
+        snprintf(url, sizeof(url), "http://[%s]/win", addr);
+    } else {
+        snprintf(url, sizeof(url), "http://%s/win", addr);
+    }
     //fprintf(stderr, "curl: %s\n", url);
 
     curl_handle = curl_easy_init();